@@ -2,15 +2,80 @@
 #define __CHIP8_H__
 
 #include "core/chip_listener.h"
+#include "core/memory_listener.h"
 
 #include "core/memory.h"
 #include "core/display.h"
 #include "core/keyboard.h"
+#include "core/recompiler.h"
+#include "core/profiler.h"
+#include "core/chip_variant.h"
 
 #include <map>
+#include <vector>
 
-class Chip8
+// Default number of return addresses on the call stack
+#define CALL_STACK_SIZE				16
+
+// Range of program memory covered by the instruction cache
+#define INSTRUCTION_CACHE_START		0x200
+#define INSTRUCTION_CACHE_END		0xFFF
+
+// An instruction decoded from memory, with the operands already split out
+typedef struct Instruction_Struct {
+	bool decoded;
+	unsigned char operation;
+	unsigned short opcode;
+	unsigned short address;
+	unsigned char register_x;
+	unsigned char register_y;
+	unsigned char value;
+} DecodedInstruction;
+
+// Longest run of instructions executed as a single basic block
+#define MAX_BLOCK_LENGTH			32
+
+// Available methods of executing instructions
+enum ExecutionEngine {STEP_ENGINE, BLOCK_ENGINE, RECOMPILER_ENGINE};
+
+// Resolution of the display (SCHIP 00FE and 00FF)
+enum GraphicMode {LORES, HIRES};
+
+// Constants of the random number generator (PCG32, with its default stream)
+#define RANDOM_MULTIPLIER			6364136223846793005ULL
+#define RANDOM_INCREMENT			1442695040888963407ULL
+
+// Number of times a block is executed before it is compiled
+#define RECOMPILE_THRESHOLD			16
+
+// Compiled code for the block starting at an address in the instruction cache
+typedef struct Recompiled_Block_Struct {
+	CompiledBlock function;
+	unsigned char length;
+	unsigned int written_registers;
+	unsigned short executions;
+	bool uncompilable;
+} RecompiledBlock;
+
+class Chip8 : public MemoryListener
 {
+	public:
+		// Common signature of the opcode handlers
+		typedef void (Chip8::* Operation) (unsigned short, unsigned char, unsigned char, unsigned char);
+
+		// A map used to convert operation codes to methods
+		typedef std::map<unsigned short, Operation> OperationMap;
+
+		// The interpreter specialized for one variant of the chip, with an
+		// entry for each way of executing instructions
+		typedef struct Interpreter_Struct {
+			void (Chip8::* step)();
+			unsigned int (Chip8::* interpret)(unsigned int);
+			unsigned int (Chip8::* interpret_profiled)(unsigned int);
+			unsigned int (Chip8::* execute_blocks)(unsigned int);
+			unsigned int (Chip8::* execute_recompiled)(unsigned int);
+		} Interpreter;
+
 	protected:
 		// Since memory can change for various implementations, utilize an
 		// external memory object
@@ -22,8 +87,52 @@ class Chip8
 
 		ChipListener* gui;
 
-		// A map used to convert operation codes to methods
-		std::map <unsigned short, void (Chip8::* ) (unsigned short, unsigned char, unsigned char, unsigned char)> operation_map;
+		// What the listener was last told, and the memory written since then.
+		// Changes are found by comparing against these once a frame, rather
+		// than informing the listener of each change as it happens.
+		ChipChanges changes;
+		unsigned short* listener_stack;
+		unsigned long listener_display_generation;
+
+		// Instructions understood by the chip, its quirks, and the interpreter
+		// specialized for them
+		InstructionSet instruction_set;
+		QuirkProfile quirks;
+		const Interpreter* interpreter;
+
+		// Flat table built from the operation map.  The operation only depends
+		// on the first nybble and the last byte of the opcode, so the table is
+		// indexed by those 12 bits, and holds an index into the list of
+		// operations (index 0 is reserved for invalid opcodes).  Instructions
+		// are executed by the interpreter's switch, so the table is only used
+		// to validate opcodes and find the ends of blocks.
+		unsigned char operation_table[0x1000];
+		std::vector<Operation> operation_list;
+
+		// Whether each operation in the list may change the flow of the program
+		std::vector<bool> operation_ends_block;
+
+		// Decoded instructions, indexed by address from the start of the cache.
+		// A slot is invalidated when memory under it is written.  The caches
+		// are allocated when the chip first executes, so forks which never run
+		// don't pay for them.
+		DecodedInstruction* instruction_cache;
+
+		// Number of instructions in the basic block starting at each address in
+		// the instruction cache, or 0 if the block hasn't been built
+		unsigned char* block_lengths;
+
+		ExecutionEngine engine;
+
+		// Native code for hot blocks, only allocated for the recompiler engine.
+		// When verifying, each compiled block is also interpreted, and the
+		// results compared.
+		Recompiler* recompiler;
+		RecompiledBlock* recompiled_blocks;
+		bool verify_recompiler;
+
+		// Counts every instruction executed, if set
+		Profiler* profiler;
 
 		// Registers -- V0 - VF
 		unsigned char registers[16];
@@ -33,6 +142,7 @@ class Chip8
 
 		// Call stack - Size allocated upon creation
 		unsigned short* call_stack;
+		unsigned char call_stack_size;
 		unsigned char stack_pointer;
 
 		// Timers
@@ -42,6 +152,21 @@ class Chip8
 		// Program counter
 		unsigned short program_counter;
 
+		// Set once the program has exited (SCHIP 00FD)
+		bool halted;
+
+		// SCHIP state:  HP48 RPL flags, and display resolution
+		unsigned char hp_registers[8];
+		GraphicMode graphicMode;
+
+		// Seed and state of the random number generator.  Each chip has its
+		// own, so a run can be repeated, and chips on different threads don't
+		// share any state.
+		unsigned int seed;
+		uint64_t random_state;
+
+		unsigned int next_random();
+
 
 		// Execution of opcodes -- each opcode takes a short (the actual opcode) as an argument
 		void _clear_screen(unsigned short, unsigned char, unsigned char, unsigned char);
@@ -81,15 +206,60 @@ class Chip8
 		void _dump_register(unsigned short, unsigned char, unsigned char, unsigned char);
 		void _load_register(unsigned short, unsigned char, unsigned char, unsigned char);
 
+		// SCHIP opcodes
+		void _scroll_down(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _scroll_right(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _scroll_left(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _exit(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _enable_extended_screen(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _disable_extended_screen(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _draw_extended(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _set_address_big_sprite(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _dump_register_rpl(unsigned short, unsigned char, unsigned char, unsigned char);
+		void _load_register_rpl(unsigned short, unsigned char, unsigned char, unsigned char);
+
 		void _invalid_opcode(unsigned short);
 
-		void create_operation_map();
+		// Sprite drawing, shared by the draw opcodes of each variant
+		template<bool clip_sprites> void draw_sprite(unsigned char, unsigned char, unsigned char);
+		template<bool clip_sprites> void draw_extended_sprite(unsigned char, unsigned char, unsigned char);
+
+		virtual void create_operation_map(OperationMap&);
+		void create_operation_table();
+		virtual unsigned short decode_opcode(unsigned short);
+		virtual bool is_block_end(unsigned short);
+
+		template<class Variant> static const Interpreter* get_interpreter();
+		void select_interpreter();
+
+		template<class Variant> void execute_instruction(const DecodedInstruction*);
+		template<class Variant, class Profiling> void step();
+		template<class Variant, class Profiling> unsigned int interpret(unsigned int);
+
+		void decode_instruction(unsigned short, DecodedInstruction*);
+		void allocate_instruction_cache();
+		void flush_instruction_cache();
+
+		void build_block(unsigned short);
+		template<class Variant> unsigned int execute_blocks(unsigned int);
+
+		template<class Variant> bool is_recompilable(DecodedInstruction*);
+		template<class Variant> void recompile_block(unsigned short);
+		void clear_recompiled_blocks();
+		void run_recompiled_block(RecompiledBlock*);
+		void verify_recompiled_block(RecompiledBlock*);
+		template<class Variant> unsigned int execute_recompiled(unsigned int);
+
+		void refresh_listener();
+		void inform_listener(bool);
+		void fork_components(Memory*, Display*, Keyboard*);
 
 	public:
 		// Constructors and destructors
 		Chip8();
 		Chip8(Memory*, Display*, Keyboard*);
 		Chip8(Memory*, Display*, Keyboard*, unsigned char);
+		virtual ~Chip8();
 
 		// High-level instructions to reset the chip, load a program,
 		// and perform a clock cycle
@@ -99,14 +269,41 @@ class Chip8
 		virtual void cycle_sound();
 		void test();
 
+		// Execute a number of instructions with the selected engine
+		unsigned int execute(unsigned int);
+		void set_engine(ExecutionEngine);
+		void set_recompiler_verification(bool);
+
+		void set_profiler(Profiler*);
+		Profiler* get_profiler();
+
+		// Select the quirks of the chip, e.g., from a ROM database
+		void set_quirks(QuirkProfile);
+		QuirkProfile get_quirks();
+
 		// Listeners
 		void add_listener(ChipListener*);
+		void memory_written(unsigned short);
+		void memory_written(unsigned short, unsigned int);
+		void memory_restored();
+		void update_listener();
+
+		// Save and restore the state of the chip
+		virtual void save(Snapshot*);
+		virtual bool restore(Snapshot*);
+
+		// Create a copy of the chip, running on forks of its components
+		virtual Chip8* fork(Memory*, Display*, Keyboard*);
 
 		// Access to program counter, stack pointer, registers, etc.
 		unsigned char get_register(unsigned char);
 		unsigned short get_address();
 		unsigned short get_program_counter();
 		unsigned char get_stack_pointer();
+		bool is_halted();
+
+		void set_seed(unsigned int);
+		unsigned int get_seed();
 
 		// Access to the display
 		bool get_pixel(unsigned char, unsigned char);
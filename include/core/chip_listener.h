@@ -1,6 +1,42 @@
 #ifndef __CHIP_LISTENER__
 #define __CHIP_LISTENER__
 
+/******************
+* Changes to a chip since its listener was last informed, and the current
+* values of everything which changed.  Written memory is given as the range
+* of addresses written, from memory_start up to (but not including)
+* memory_end.
+******************/
+typedef struct ChipChanges_Struct {
+	// Bit n is set if register Vn changed
+	unsigned short changed_registers;
+	unsigned char registers[16];
+
+	bool address_register_changed;
+	unsigned short address_register;
+
+	bool program_counter_changed;
+	unsigned short program_counter;
+
+	bool stack_changed;
+	unsigned short* stack;
+	unsigned char stack_pointer;
+	unsigned char stack_size;
+
+	bool delay_timer_changed;
+	unsigned short delay_timer;
+
+	bool sound_timer_changed;
+	unsigned short sound_timer;
+
+	bool display_changed;
+
+	bool memory_changed;
+	unsigned short memory_start;
+	unsigned short memory_end;
+} ChipChanges;
+
+
 class ChipListener
 {
 	public:
@@ -15,6 +51,49 @@ class ChipListener
 		virtual void update_delay_timer(unsigned short) = 0;
 		virtual void update_sound_timer(unsigned short) = 0;
 
+		// Everything which changed since the last update, at most once a frame.
+		// By default, this calls the method for each change above.
+		virtual void update_changes(const ChipChanges* changes)
+		{
+			for(int i=0; i<0x10; i++)
+			{
+				if(changes->changed_registers & (1 << i))
+				{
+					update_register(i, changes->registers[i]);
+				}
+			}
+
+			if(changes->address_register_changed)
+			{
+				update_address_register(changes->address_register);
+			}
+			if(changes->program_counter_changed)
+			{
+				update_program_counter(changes->program_counter);
+			}
+			if(changes->stack_changed)
+			{
+				update_stack_pointer(changes->stack_pointer);
+				update_stack(changes->stack, changes->stack_pointer, changes->stack_size);
+			}
+			if(changes->delay_timer_changed)
+			{
+				update_delay_timer(changes->delay_timer);
+			}
+			if(changes->sound_timer_changed)
+			{
+				update_sound_timer(changes->sound_timer);
+			}
+			if(changes->memory_changed)
+			{
+				update_memory();
+			}
+			if(changes->display_changed)
+			{
+				refresh_display();
+			}
+		}
+
 		~ChipListener() {}
 
 	protected:
@@ -22,4 +101,4 @@ class ChipListener
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,72 @@
+#ifndef __CHIP_VARIANT_H__
+#define __CHIP_VARIANT_H__
+
+#include <string>
+
+// Instruction sets the interpreter can be specialized for
+enum InstructionSet {CHIP8_INSTRUCTIONS, SCHIP8_INSTRUCTIONS};
+
+// Named sets of quirks, which programs written for different interpreters
+// rely on
+enum QuirkProfile {DEFAULT_QUIRKS, COSMAC_QUIRKS, SCHIP_QUIRKS, NUM_QUIRK_PROFILES};
+
+/******************
+* Quirks
+*
+* Policy describing how the chip being emulated differs in the behaviour of
+* a few instructions.
+*
+*   shift_vy - 8XY6 and 8XYE shift VY into VX, as on the COSMAC VIP, rather
+*              than shifting VX in place
+*   load_store_keeps_i - FX55 and FX65 leave I unchanged, as on SCHIP 1.1,
+*                        rather than pointing it past the last register
+*   jump_vx - BXNN jumps to XNN plus VX, as on SCHIP 1.1, rather than plus V0
+*   clip_sprites - sprites are clipped at the right and bottom of the
+*                  screen, rather than wrapping around to the other side.
+*                  Sprites starting off the screen always wrap.
+******************/
+template<bool shift_vy, bool load_store_keeps_i, bool jump_vx, bool clip_sprites>
+class Quirks
+{
+	public:
+		static const bool SHIFT_VY = shift_vy;
+		static const bool LOAD_STORE_KEEPS_I = load_store_keeps_i;
+		static const bool JUMP_VX = jump_vx;
+		static const bool CLIP_SPRITES = clip_sprites;
+};
+
+// The quirks of each profile.  The default is how this emulator has always
+// behaved.
+typedef Quirks<false, false, false, false> DefaultQuirks;
+typedef Quirks<true, false, false, true> CosmacQuirks;
+typedef Quirks<false, true, true, true> SChipQuirks;
+
+/******************
+* ChipVariant
+*
+* Policy describing the instructions and quirks of the chip being emulated.
+* The interpreter is a template on a variant, so each one compiles to its own
+* switch over the opcodes, and the flags are resolved at compile time rather
+* than checked on each instruction.
+*
+*   super_chip - the SCHIP instructions (scrolling, exit, extended screen,
+*                16x16 sprites, big font and RPL flags) are available
+*   ChipQuirks - one of the Quirks above
+******************/
+template<bool super_chip, class ChipQuirks>
+class ChipVariant : public ChipQuirks
+{
+	public:
+		static const bool SUPER_CHIP = super_chip;
+};
+
+// Variants emulated by the Chip8 and SChip8 classes by default
+typedef ChipVariant<false, DefaultQuirks> Chip8Variant;
+typedef ChipVariant<true, DefaultQuirks> SChip8Variant;
+
+// Names of the quirk profiles, as used in ROM databases and on the command
+// line
+const char* get_quirk_profile_name(QuirkProfile);
+bool find_quirk_profile(const std::string&, QuirkProfile*);
+
+#endif
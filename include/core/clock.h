@@ -1,30 +1,69 @@
 #ifndef __CLOCK_H__
 #define __CLOCK_H__
 
+#include <atomic>
+#include <chrono>
 #include <thread>
-#include <unistd.h>
 
 #include "core/chip8.h"
+#include "core/clock_listener.h"
 
+class Rewind;
+class FrameBuffer;
+
+// The timers count down at 60Hz, and a frame is the time between ticks
+#define FRAMES_PER_SECOND					60
+
+// How far a real time clock may fall behind before it gives up catching up
+#define MAX_FRAMES_BEHIND					5
+
+// Roughly the 500Hz of the original clock
+#define DEFAULT_INSTRUCTIONS_PER_FRAME		8
+
+enum ClockPacing {REAL_TIME, UNTHROTTLED};
+
+/******************
+* Clock
+*
+* Runs the chip a frame at a time:  a fixed number of instructions, followed
+* by a tick of the delay and sound timers, so the ratio of instructions to
+* timer ticks doesn't depend on how the threads are scheduled.
+*
+* Frames can be run directly with run_frame(), or by a single thread started
+* with start().  The thread paces the frames to real time (or a multiple of
+* it), or runs them as fast as possible.
+*
+* If given a rewind history, each frame is recorded in it after it is run.
+* While rewinding, each frame steps back through the history instead, so the
+* computer runs backwards at the same pace it ran forwards.
+*
+* If given a frame buffer, the display is published to it at the end of each
+* frame in which it changed, for another thread to draw.
+******************/
 class Clock
 {
 	private:
-		useconds_t clock_period;
-		useconds_t delay_period;
-		useconds_t sound_period;
+		// Settings may be changed from other threads while the clock runs
+		std::atomic<unsigned int> instructions_per_frame;
+
+		std::atomic<ClockPacing> pacing;
+		std::atomic<double> speed;
+
+		std::atomic<unsigned long> frame_count;
 
 		std::thread clock_thread;
-		std::thread delay_thread;
-		std::thread sound_thread;
 
-		bool running;
-		bool exists;
+		std::atomic<bool> running;
+		std::atomic<bool> exists;
+		std::atomic<bool> rewinding;
 
 		Chip8* chip;
+		Rewind* rewind;
+		FrameBuffer* frame_buffer;
+
+		ClockListener* listener;
 
-		void runChipClock();
-		void runDelayClock();
-		void runSoundClock();
+		void runClock();
 
 	public:
 		Clock(Chip8* );
@@ -32,6 +71,28 @@ class Clock
 		void start();
 		void run();
 		void pause();
+		bool is_running();
+
+		unsigned int run_frame();
+
+		void set_instructions_per_frame(unsigned int);
+		unsigned int get_instructions_per_frame();
+
+		void set_pacing(ClockPacing);
+		ClockPacing get_pacing();
+		void set_speed(double);
+		double get_speed();
+
+		unsigned long get_frame_count();
+
+		void add_listener(ClockListener*);
+
+		void set_rewind(Rewind*);
+		void set_rewinding(bool);
+		bool is_rewinding();
+
+		void set_frame_buffer(FrameBuffer*);
+		FrameBuffer* get_frame_buffer();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,20 @@
+#ifndef __CLOCK_LISTENER__
+#define __CLOCK_LISTENER__
+
+class ClockListener
+{
+	public:
+		// A frame is about to run, e.g., to feed in the keys for the frame
+		virtual void frame_starting() = 0;
+
+		// The clock has stepped back a frame through its rewind history
+		virtual void frame_rewound() = 0;
+
+		~ClockListener() {}
+
+	protected:
+		ClockListener() {}
+
+};
+
+#endif
@@ -6,6 +6,9 @@
 #include "core/display.h"
 #include "core/keyboard.h"
 #include "core/clock.h"
+#include "core/snapshot.h"
+#include "core/rom_database.h"
+#include "core/rom_catalog.h"
 
 class Computer
 {
@@ -16,6 +19,20 @@ class Computer
 		Display* display;
 		Clock* clock;
 
+		// Picks the quirks of the chip for each program loaded, if set
+		RomDatabase* rom_database;
+
+		// Reads each program once, and keeps what is known about it, if set
+		RomCatalog* rom_catalog;
+
+		// The state before the last restore, to undo a restore which fails
+		// part way through
+		Snapshot* rollback;
+
+		// Whether the components were created by the computer (by forking),
+		// and should be deleted with it
+		bool owns_components;
+
 	public:
 		Computer();
 		Computer(Chip8*, Clock*, Memory*, Display*, Keyboard*);
@@ -32,12 +49,26 @@ class Computer
 
 		void cycle();
 		void cycle_timers();
+		unsigned int run_frame();
 		void run();
 		void pause();
 
+		Clock* get_clock();
+		Chip8* get_chip();
+		Keyboard* get_keyboard();
+		Memory* get_memory();
+
+		void set_rom_database(RomDatabase*);
+		void set_rom_catalog(RomCatalog*);
 		void load(const char*);
+		void load(const CatalogEntry*);
 		void soft_reset();
 
+		bool save(Snapshot*);
+		bool restore(Snapshot*);
+
+		Computer* fork();
+
 		std::string get_memory_string();
 };
 
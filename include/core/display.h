@@ -1,33 +1,116 @@
 #ifndef __DISPLAY_H__
 #define __DISPLAY_H__
 
+#include "core/display_kernels.h"
+
+#include <atomic>
+#include <stdint.h>
+
+class Snapshot;
+
+// Pixels are addressed by unsigned chars
+#define DISPLAY_MAX_SIZE		256
+
+// Rows of the display are grouped into pages, which are shared between forks
+// of a display until one of them draws on the page
+#define DISPLAY_PAGE_WORDS		32
+#define DISPLAY_MAX_PAGES		(DISPLAY_MAX_SIZE * DISPLAY_MAX_SIZE / 64 / DISPLAY_PAGE_WORDS)
+
+// Pages are allocated on cache line boundaries, with the words first, so
+// clearing and scrolling a page works on whole lines
+#define DISPLAY_PAGE_ALIGNMENT	64
+
+typedef struct DisplayPage_Struct {
+	uint64_t words[DISPLAY_PAGE_WORDS];
+	std::atomic<unsigned int> references;
+} DisplayPage;
+
+/******************
+* Display
+*
+* Monochrome framebuffer.  Pixels are packed into 64-bit words, with each row
+* starting on a new word, and the leftmost pixel of a word in its most
+* significant bit.  A 64x32 display is one word per row, and a 128x64 SCHIP
+* display is two.
+*
+* Rows are stored in 256 byte pages:  the whole of a 64x32 display, or 16 rows
+* of a 128x64 display.  Blank pages are shared with a single blank page, and
+* forks of a display share all of its pages, until they are drawn on.
+******************/
 class Display
 {
 	private:
-		bool** display;
+		DisplayPage* pages[DISPLAY_MAX_PAGES];
+
+		// The page shared by every blank page, kept here so it can be compared
+		// against without a call
+		DisplayPage* blank_page;
 
 		unsigned int width, height;
+		unsigned int words_per_row;
+		unsigned int rows_per_page;
+		unsigned int num_pages;
+
+		// The page each row is in, and the offset of the row within the page
+		unsigned char row_page[DISPLAY_MAX_SIZE];
+		unsigned char row_offset[DISPLAY_MAX_SIZE];
+
+		const DisplayKernels* kernels;
+
+		// Counts changes to the display, so a change can be spotted without
+		// comparing the pixels
+		unsigned long generation;
+
+		void allocate();
+
+		void release_page(unsigned int);
+		void own_page(unsigned int);
+		unsigned int get_page_rows(unsigned int);
+
+		const uint64_t* get_row(unsigned char);
+		uint64_t* get_writable_row(unsigned char);
+		uint64_t get_mask(unsigned char);
+
+		bool write_bits(unsigned char, unsigned char, uint64_t);
+		bool write_clipped_bits(unsigned char, unsigned char, uint64_t);
+
+		Display(const Display*);
 
 	public:
 		Display();
 		Display(unsigned int, unsigned int);
+		~Display();
+
+		Display* fork();
+
+		void set_kernels(const DisplayKernels*);
 
 		bool set_pixel(unsigned char, unsigned char);
 		bool flip_pixel(unsigned char, unsigned char);
 
 		bool get_pixel(unsigned char, unsigned char);
 		bool write_line(unsigned char, unsigned char, unsigned char);
+		bool write_wide_line(unsigned char, unsigned char, unsigned short);
+		bool write_clipped_line(unsigned char, unsigned char, unsigned char);
+		bool write_clipped_wide_line(unsigned char, unsigned char, unsigned short);
 		void show();
 		void clear();
-	
+
 		unsigned int get_width();
 		unsigned int get_height();
+		unsigned int get_words_per_row();
+		unsigned long get_generation();
+
+		void copy_rows(uint64_t*);
 
 		void resize(unsigned int, unsigned int);
 
 		void scroll_down(unsigned char);
 		void scroll_left(unsigned char);
 		void scroll_right(unsigned char);
+
+		void save(Snapshot*);
+		bool restore(Snapshot*);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef __DISPLAY_KERNELS_H__
+#define __DISPLAY_KERNELS_H__
+
+#include <stdint.h>
+
+/******************
+* Display kernels
+*
+* Horizontal scrolls of a packed framebuffer (see Display), specialised for
+* the 64 pixel (one word) and 128 pixel (two word) wide displays.  Each kernel
+* shifts every row of the framebuffer by fewer than 64 pixels, filling the
+* vacated columns with blank pixels.
+*
+* Kernels are provided as portable C++, and with SSE2 and AVX2 on x86
+* processors which support them.  get_display_kernels() picks the fastest set
+* the processor supports when first called.
+******************/
+
+enum DisplayKernelSet {SCALAR_KERNELS, SSE2_KERNELS, AVX2_KERNELS};
+
+typedef void (*ScrollKernel)(uint64_t* display, unsigned int num_rows, unsigned int num_cols);
+
+typedef struct DisplayKernels_Struct {
+	const char* name;
+
+	ScrollKernel scroll_left_64;
+	ScrollKernel scroll_right_64;
+	ScrollKernel scroll_left_128;
+	ScrollKernel scroll_right_128;
+} DisplayKernels;
+
+// The fastest kernels available on this processor
+const DisplayKernels* get_display_kernels();
+
+// A specific set of kernels, or NULL if the processor doesn't support it
+const DisplayKernels* get_display_kernels(DisplayKernelSet);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __FRAME_BUFFER_H__
+#define __FRAME_BUFFER_H__
+
+#include "core/display.h"
+
+#include <atomic>
+#include <stdint.h>
+
+// Enough words for the largest display
+#define FRAME_MAX_WORDS			(DISPLAY_MAX_SIZE * DISPLAY_MAX_SIZE / 64)
+
+// Set in the index of the middle frame when it hasn't been taken yet
+#define FRAME_BUFFER_FRESH		0x4
+#define FRAME_BUFFER_INDEX		0x3
+
+/******************
+* A copy of the display at the end of a frame, packed as in Display:  each
+* row is words_per_row words, with the leftmost pixel of a word in its most
+* significant bit.
+******************/
+typedef struct Frame_Struct {
+	unsigned int width;
+	unsigned int height;
+	unsigned int words_per_row;
+
+	// The display's generation when it was copied
+	unsigned long generation;
+
+	uint64_t words[FRAME_MAX_WORDS];
+} Frame;
+
+inline bool get_frame_pixel(const Frame* frame, unsigned int x, unsigned int y)
+{
+	return (frame->words[y * frame->words_per_row + x / 64] >> (63 - x % 64)) & 1;
+}
+
+/******************
+* FrameBuffer
+*
+* Hands complete frames of a display from the thread running the chip to the
+* thread drawing them, without either thread waiting for the other.
+*
+* There are three frames:  the back frame, which the chip's thread copies
+* the display into, the front frame, which the drawing thread reads, and the
+* middle frame, the newest complete frame.  Publishing a frame swaps the back
+* and middle frames, and taking one swaps the middle and front frames, each
+* with a single atomic exchange, so the drawing thread always gets the newest
+* complete frame, and never one being written.
+******************/
+class FrameBuffer
+{
+	private:
+		Display* display;
+
+		Frame frames[3];
+
+		// Only used by the chip's thread
+		unsigned int back;
+		unsigned long published_generation;
+
+		// Index of the newest complete frame, with FRAME_BUFFER_FRESH set if
+		// it hasn't been taken
+		std::atomic<unsigned int> middle;
+
+		// Only used by the drawing thread
+		unsigned int front;
+
+	public:
+		FrameBuffer(Display*);
+
+		bool publish();
+		const Frame* take();
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/computer.h"
+#include "core/host_listener.h"
+
+// Longest a worker sleeps when it has nothing to run, in case computers are
+// added or resumed
+#define HOST_IDLE_PERIOD_MICROSECONDS		2000
+
+// Number of frames the lateness of a worker is averaged over
+#define HOST_LAG_FRAMES						60
+
+
+typedef struct HostedComputer_Struct {
+	Computer* computer;
+
+	// When the next frame is due, if paced to real time
+	std::chrono::steady_clock::time_point next_frame;
+} HostedComputer;
+
+
+typedef struct HostWorker_Struct {
+	std::thread thread;
+
+	// Computers waiting for this worker to run their next frame
+	std::mutex queue_mutex;
+	std::deque<HostedComputer*> queue;
+
+	// How late paced frames have been run recently, in seconds and in frames
+	std::atomic<double> lag;
+	double frames_behind;
+	std::atomic<bool> behind;
+
+	std::atomic<unsigned long> frames_run;
+	std::atomic<unsigned long> computers_stolen;
+} HostWorker;
+
+
+/******************
+* Host
+*
+* Runs many computers on a fixed pool of worker threads.  Each computer is a
+* cooperative task, which runs one frame (see Clock::run_frame) at a time
+* before going to the back of its worker's queue.  The clock of each computer
+* isn't started;  the host uses its run / pause state, pacing and speed as
+* the target for that computer instead.
+*
+* A worker with an empty queue, or with nothing due, steals computers from
+* the back of the other workers' queues.  Workers which run frames more than
+* a frame late are reported to the listener as falling behind.
+******************/
+class Host
+{
+	private:
+		std::vector<HostWorker*> workers;
+
+		std::mutex computers_mutex;
+		std::vector<HostedComputer*> computers;
+
+		std::atomic<bool> exists;
+		bool started;
+
+		HostListener* listener;
+
+		void create_workers(unsigned int);
+
+		HostedComputer* take_computer(unsigned int);
+		HostedComputer* steal_computer(unsigned int);
+		void return_computer(unsigned int, HostedComputer*);
+
+		bool run_computer(unsigned int, HostedComputer*, std::chrono::steady_clock::time_point&);
+		void update_lag(unsigned int, double, double);
+
+		void runWorker(unsigned int);
+
+	public:
+		Host();
+		Host(unsigned int);
+		~Host();
+
+		void add(Computer*);
+		void add_listener(HostListener*);
+
+		void start();
+		void stop();
+
+		unsigned int get_num_workers();
+		double get_worker_lag(unsigned int);
+		unsigned long get_frames_run(unsigned int);
+		unsigned long get_computers_stolen(unsigned int);
+};
+
+#endif
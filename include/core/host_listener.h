@@ -0,0 +1,21 @@
+#ifndef __HOST_LISTENER__
+#define __HOST_LISTENER__
+
+class HostListener
+{
+	public:
+		// A worker is running its frames more than a frame late, and by how
+		// many seconds
+		virtual void worker_falling_behind(unsigned int, double) = 0;
+
+		// A worker which had fallen behind is back on time
+		virtual void worker_caught_up(unsigned int) = 0;
+
+		~HostListener() {}
+
+	protected:
+		HostListener() {}
+
+};
+
+#endif
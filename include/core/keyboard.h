@@ -1,17 +1,44 @@
 #ifndef __KEYBOARD_H__
 #define __KEYBOARD_H__
 
+#include "core/snapshot.h"
+
+#include <atomic>
+
+/******************
+* Keyboard
+*
+* The 16 keys of the keypad.  Keys are normally pressed and released
+* immediately, but when latched, presses and releases are held until latch()
+* is called, so a program sees the same keys for a whole frame regardless of
+* when they were pressed, e.g., when recording a replay.
+******************/
 class Keyboard
 {
 	private:
 		bool keys[0x10];
 
+		// Keys pressed since the last latch(), as a mask with bit n for key n
+		std::atomic<unsigned short> pending;
+		std::atomic<bool> latched;
+
 	public:
 		Keyboard();
+		Keyboard(const Keyboard&);
 
 		bool is_key_pressed(unsigned char key);
 		void press_key(unsigned char key);
 		void release_key(unsigned char key);
+		void consume_key(unsigned char key);
+
+		unsigned short get_key_mask();
+		void set_key_mask(unsigned short);
+
+		void set_latched(bool);
+		void latch();
+
+		void save(Snapshot*);
+		bool restore(Snapshot*);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,19 +1,56 @@
 #ifndef __MEMORY_H__
 #define __MEMORY_H__
 
+#include "core/memory_listener.h"
+
+#include <atomic>
 #include <string>
 
+class Snapshot;
+
+// Memory is split into pages, which are shared between forks of a memory
+// until one of them writes to the page
+#define MEMORY_SIZE				0x1000
+#define MEMORY_PAGE_SIZE		0x100
+#define MEMORY_PAGES			(MEMORY_SIZE / MEMORY_PAGE_SIZE)
+
+// Addresses wrap around the end of memory, as on the COSMAC VIP
+#define MEMORY_ADDRESS_MASK		(MEMORY_SIZE - 1)
+
+// Memory is shown as lines of 16 bytes, each written as
+// "0xXXXX: XX XX ... XX\n", so every line has the same length and a line can
+// be rewritten in place.  Writes mark the line they fall in as dirty.
+#define MEMORY_LINE_SIZE		16
+#define MEMORY_LINES			(MEMORY_SIZE / MEMORY_LINE_SIZE)
+#define MEMORY_LINE_LENGTH		(8 + 3*MEMORY_LINE_SIZE)
+#define MEMORY_TEXT_LENGTH		(MEMORY_LINES * MEMORY_LINE_LENGTH)
+
+typedef struct MemoryPage_Struct {
+	std::atomic<unsigned int> references;
+	unsigned char data[MEMORY_PAGE_SIZE];
+} MemoryPage;
+
 /******************
 * Memory
 *
 * Storage and mapping to RAM, interpreter, and video refresh
+*
+* fetch() and dump() are inlined, as the chip calls them for every opcode
+* decoded and byte of sprite drawn.  Addresses are masked to 12 bits rather
+* than checked, and writes outside of RAM are dropped.  Building with
+* CHECKED_MEMORY defined counts every access which had to be masked, and
+* every write dropped, as a violation, to find programs which rely on them.
 ******************/
 class Memory
 {
 	private:
-		// Actual location of memory on the heap
+		// Actual location of memory on the heap, as pages which may be shared
+		// with other memories
 		unsigned short memory_size;
-		unsigned char* memory;
+		MemoryPage* pages[MEMORY_PAGES];
+
+		unsigned char* get_writable(unsigned short);
+		void copy_to_pages(unsigned short, const unsigned char*, unsigned int);
 
 		// Boundaries of each section of memory
 		unsigned short _system_memory_start;
@@ -27,10 +64,37 @@ class Memory
 		void load_sprites();
 		void load_big_sprites();
 
+		// Informed of every write to memory
+		MemoryListener* listener;
+
+		// Accesses outside of memory, and writes outside of RAM, counted when
+		// built with CHECKED_MEMORY
+		unsigned long violations;
+
+		// Bit n is set if line n has been written since it was last rendered
+		uint64_t dirty_lines[MEMORY_LINES / 64];
+		void mark_all_dirty();
+		void mark_dirty(unsigned short, unsigned int);
+		void render_line(unsigned short, char*);
+
+		Memory(const Memory*);
+
 	public:
 		Memory();
+		~Memory();
+
+		Memory* fork();
 		unsigned char fetch(unsigned short);
 		void dump(unsigned short, unsigned char);
+		void write(unsigned short, const unsigned char*, unsigned int);
+		unsigned int load_program(const unsigned char*, unsigned int);
+
+		void add_listener(MemoryListener*);
+
+		void save(Snapshot*);
+		bool restore(Snapshot*);
+
+		unsigned long get_violations();
 
 		unsigned short get_ram_start();
 		void print_memory(unsigned short, unsigned short);
@@ -43,6 +107,86 @@ class Memory
 
 		std::string to_string(unsigned int);
 
+		bool has_dirty_lines();
+		unsigned int render_dirty_lines(char*);
+
 };
 
+
+/*******************
+* unsigned char fetch(short address)
+*
+* Return the byte at the give address in memory
+*
+* Parameters:
+*   address - memory location to retrieve a byte from, wrapped around the
+*             end of memory
+*
+* Return:
+*   value at the provided memory address
+******************/
+inline unsigned char Memory::fetch(unsigned short address)
+{
+#ifdef CHECKED_MEMORY
+	if(address > MEMORY_ADDRESS_MASK)
+	{
+		violations++;
+	}
+#endif
+
+	address &= MEMORY_ADDRESS_MASK;
+
+	return pages[address / MEMORY_PAGE_SIZE]->data[address % MEMORY_PAGE_SIZE];
+}
+
+
+/*******************
+* void dump(short address, char value)
+*
+* Write the byte to the provided address, unless it is outside of RAM
+*
+* Parameters:
+*   address - memory location to write to, wrapped around the end of memory
+*   value   - byte value to write
+*******************/
+inline void Memory::dump(unsigned short address, unsigned char value)
+{
+#ifdef CHECKED_MEMORY
+	if(address > MEMORY_ADDRESS_MASK)
+	{
+		violations++;
+	}
+#endif
+
+	address &= MEMORY_ADDRESS_MASK;
+
+	// The interpreter's memory can't be written
+	if(address < _ram_start)
+	{
+#ifdef CHECKED_MEMORY
+		violations++;
+#endif
+		return;
+	}
+
+	// Only a page shared with a fork needs copying first
+	MemoryPage* page = pages[address / MEMORY_PAGE_SIZE];
+	if(page->references == 1)
+	{
+		page->data[address % MEMORY_PAGE_SIZE] = value;
+	}
+	else
+	{
+		*get_writable(address) = value;
+	}
+
+	unsigned short line = address / MEMORY_LINE_SIZE;
+	dirty_lines[line / 64] |= ((uint64_t) 1) << (line % 64);
+
+	if(listener)
+	{
+		listener->memory_written(address);
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef __MEMORY_LISTENER__
+#define __MEMORY_LISTENER__
+
+class MemoryListener
+{
+	public:
+		virtual void memory_written(unsigned short) = 0;
+
+		// A run of bytes has been written in one go
+		virtual void memory_written(unsigned short, unsigned int) = 0;
+
+		// The whole of memory has been replaced, e.g., from a snapshot
+		virtual void memory_restored() = 0;
+
+		~MemoryListener() {}
+
+	protected:
+		MemoryListener() {}
+
+};
+
+#endif
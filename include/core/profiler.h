@@ -0,0 +1,96 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "core/memory.h"
+
+#include <ostream>
+
+// Lengths of the lists in a report
+#define PROFILE_HOT_INSTRUCTIONS	20
+#define PROFILE_LOOPS				10
+
+/******************
+* Profiler
+*
+* Counts the instructions a chip executes:  how often the instruction at
+* each address runs, how often each operation runs, and how often each
+* backward jump is taken, which marks the end of a loop.  The report lists
+* the hottest instructions, disassembled, the operations, and the loops
+* which the most instructions were spent in.
+*
+* A profiler should only be used by one chip at a time.
+******************/
+class Profiler
+{
+	private:
+		unsigned long total;
+
+		// Executions of the instruction at each address, and the opcode last
+		// executed there
+		unsigned long address_counts[MEMORY_SIZE];
+		unsigned short opcodes[MEMORY_SIZE];
+
+		// Executions of each opcode, indexed by its first nybble and last
+		// byte, as in the chip's dispatch table
+		unsigned long opcode_counts[0x1000];
+
+		// Backward jumps taken from each address, and where they went
+		unsigned long backward_jumps[MEMORY_SIZE];
+		unsigned short jump_targets[MEMORY_SIZE];
+
+	public:
+		Profiler();
+
+		void clear();
+
+		// Count the opcode at the address having been executed, leaving the
+		// program counter at next_address
+		inline void count(unsigned short address, unsigned short opcode, unsigned short next_address)
+		{
+			address &= MEMORY_SIZE - 1;
+
+			total++;
+			address_counts[address]++;
+			opcodes[address] = opcode;
+			opcode_counts[((opcode & 0xF000) >> 4) | (opcode & 0x00FF)]++;
+
+			// Only jumps back to an earlier address close a loop;  returns
+			// also go back, but to wherever the subroutine was called from
+			unsigned short operation = opcode & 0xF000;
+			if((operation == 0x1000 || operation == 0xB000) && next_address <= address)
+			{
+				backward_jumps[address]++;
+				jump_targets[address] = next_address & (MEMORY_SIZE - 1);
+			}
+		}
+
+		unsigned long get_total();
+		unsigned long get_count(unsigned short);
+
+		void report(std::ostream&);
+};
+
+
+/******************
+* Profiling policies
+*
+* The interpreter is a template on one of these, so counting can be compiled
+* out entirely.  executed() is called after each instruction.
+******************/
+class NoProfiling
+{
+	public:
+		static inline void executed(Profiler*, unsigned short, unsigned short, unsigned short) {}
+};
+
+
+class InstructionProfiling
+{
+	public:
+		static inline void executed(Profiler* profiler, unsigned short address, unsigned short opcode, unsigned short next_address)
+		{
+			profiler->count(address, opcode, next_address);
+		}
+};
+
+#endif
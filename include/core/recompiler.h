@@ -0,0 +1,66 @@
+#ifndef __RECOMPILER_H__
+#define __RECOMPILER_H__
+
+// Size of the buffer holding compiled code
+#define RECOMPILER_BUFFER_SIZE		0x40000
+
+// A compiled block is called with the chip's registers (V0 - VF) and address
+// register (I)
+typedef void (*CompiledBlock)(unsigned char*, unsigned short*);
+
+/******************
+* Recompiler
+*
+* Translates runs of CHIP-8 register and arithmetic instructions into x86-64
+* machine code.  The registers used by a block are held in host registers
+* for the duration of the block.  On other hosts, nothing is compiled.
+******************/
+class Recompiler
+{
+	private:
+		// Memory for compiled blocks.  Pages holding compiled code are
+		// executable, and only made writable again while a block is written.
+		unsigned char* buffer;
+		unsigned int buffer_used;
+		unsigned int page_size;
+
+		bool protect(unsigned int, unsigned int, bool);
+
+		// Where the current block is being written
+		unsigned char* code;
+
+		// Host register assigned to each CHIP-8 register (V0 - VF, then I)
+		int host_registers[17];
+
+		int allocate_registers(const unsigned short*, unsigned int);
+
+		void emit(unsigned char);
+		void emit_word(unsigned int);
+		void emit_rex(bool, int, int);
+
+		void emit_mov(int, int);
+		void emit_alu(unsigned char, int, int);
+		void emit_alu_immediate(unsigned char, int, unsigned int);
+		void emit_mov_immediate(int, unsigned int);
+		void emit_shift(unsigned char, int, unsigned char);
+		void emit_load_register(int, unsigned char);
+		void emit_store_register(int, unsigned char);
+		void emit_load_address(int);
+		void emit_store_address(int);
+
+		void emit_instruction(unsigned short);
+
+	public:
+		Recompiler();
+		~Recompiler();
+
+		bool is_available();
+
+		static bool can_compile(unsigned short);
+		static unsigned int get_written_registers(unsigned short);
+
+		unsigned int compile(const unsigned short*, unsigned int, CompiledBlock*);
+		void reset();
+};
+
+#endif
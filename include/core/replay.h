@@ -0,0 +1,86 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "core/clock_listener.h"
+#include "core/snapshot.h"
+
+#include <stdint.h>
+#include <vector>
+
+class Computer;
+
+#define REPLAY_MAGIC			0x52384843		// "CH8R"
+#define REPLAY_VERSION			2
+
+enum ReplayMode {REPLAY_STOPPED, REPLAY_RECORDING, REPLAY_PLAYING};
+
+// A number of consecutive frames with the same keys pressed
+typedef struct ReplayRun_Struct {
+	unsigned short keys;
+	unsigned int frames;
+} ReplayRun;
+
+/******************
+* Replay
+*
+* A recording of a run of a computer:  the seed of its random number
+* generator, the number of instructions per frame, and which keys were
+* pressed in each frame, run length encoded.  Hashes of the state of the
+* computer when recording started and stopped are kept, so playing the
+* replay back can check that it started from, and reached, the same state.
+*
+* While recording or playing, the replay listens to the clock.  Recording
+* latches the keyboard, so keys only change between frames, and records the
+* keys at the start of each frame.  Playing presses the recorded keys at the
+* start of each frame instead.  Frames stepped back through by rewinding are
+* removed from a recording.
+******************/
+class Replay : public ClockListener
+{
+	private:
+		Computer* computer;
+		ReplayMode mode;
+
+		unsigned int seed;
+		unsigned int instructions_per_frame;
+
+		// Keys pressed when recording started
+		unsigned short start_keys;
+
+		uint64_t start_hash;
+		uint64_t end_hash;
+
+		std::vector<ReplayRun> runs;
+		unsigned int num_frames;
+
+		// Position of playback
+		unsigned int frame;
+		unsigned int run;
+		unsigned int run_frame;
+
+		uint64_t hash_state();
+
+	public:
+		Replay();
+		virtual ~Replay() {}
+
+		void record(Computer*);
+		bool play(Computer*);
+		void stop();
+
+		bool is_finished();
+		bool check();
+
+		bool save(const char*);
+		bool load(const char*);
+
+		unsigned int get_seed();
+		unsigned int get_instructions_per_frame();
+		unsigned int get_num_frames();
+
+		// Clock listener
+		void frame_starting();
+		void frame_rewound();
+};
+
+#endif
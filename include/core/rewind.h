@@ -0,0 +1,80 @@
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+#include "core/snapshot.h"
+
+class Computer;
+
+// Default length of the history, in frames (one minute at 60Hz)
+#define REWIND_FRAMES			3600
+
+// Space for the history.  Most frames change a few registers and display
+// words, and take tens of bytes, so this is rarely the limit.
+#define REWIND_CAPACITY			0x80000
+
+// Bytes stored with each frame, besides its delta:  the length of the delta
+// at each end, so the history can be walked from either end, and the size of
+// the previous snapshot
+#define REWIND_RECORD_OVERHEAD	6
+
+/******************
+* Rewind
+*
+* A history of the last few seconds of a computer, which can be stepped back
+* through a frame at a time.  The computer is snapshot after each frame, and
+* the difference from the snapshot before it is stored, XORed with it and
+* run length encoded, in a fixed size ring buffer.  The oldest frames are
+* dropped once the history is full.
+*
+* Stepping back applies the newest delta to the newest snapshot, so only the
+* snapshots of the newest frame, and the one being restored, are ever
+* decoded.
+******************/
+class Rewind
+{
+	private:
+		Computer* computer;
+
+		Snapshot snapshot;
+
+		// The snapshot of the newest frame in the history.  Bytes past its
+		// size are always zero.
+		unsigned char state[SNAPSHOT_CAPACITY];
+		unsigned int state_size;
+
+		// Deltas encoded before being copied into the history
+		unsigned char delta[SNAPSHOT_CAPACITY * 2];
+
+		// Ring buffer of deltas, from the oldest (at head) to the newest
+		unsigned char* history;
+		unsigned int capacity;
+		unsigned int head;
+		unsigned int used;
+
+		unsigned int num_frames;
+		unsigned int max_frames;
+
+		unsigned int encode_delta(const unsigned char*, unsigned int);
+		void apply_delta(unsigned int, unsigned int);
+
+		void write_history(unsigned int, const unsigned char*, unsigned int);
+		void read_history(unsigned int, unsigned char*, unsigned int);
+		unsigned short read_history_short(unsigned int);
+
+		void drop_oldest();
+
+	public:
+		Rewind(Computer*);
+		Rewind(Computer*, unsigned int);
+		~Rewind();
+
+		void record();
+		bool step_back();
+		void clear();
+
+		unsigned int get_num_frames();
+		unsigned int get_max_frames();
+		unsigned int get_size();
+};
+
+#endif
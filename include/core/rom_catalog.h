@@ -0,0 +1,88 @@
+#ifndef __ROM_CATALOG_H__
+#define __ROM_CATALOG_H__
+
+#include "core/chip_variant.h"
+#include "core/rom_database.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define ROM_CATALOG_MAGIC			0x43384843		// "CH8C"
+#define ROM_CATALOG_VERSION			1
+
+// Chips a ROM can be written for.  Only CHIP-8 and SCHIP ROMs are run as
+// intended; the others are recognised so they can be told apart.
+enum RomVariant {CHIP8_ROM, SCHIP_ROM, CHIP8X_ROM, MEGACHIP_ROM, NUM_ROM_VARIANTS};
+
+// Everything known about a ROM file.  The file's size and modification time
+// tell whether the file has changed since it was cataloged.
+typedef struct CatalogEntry_Struct {
+	std::string filename;
+	uint64_t file_size;
+	int64_t modified;
+
+	uint64_t hash;
+	RomVariant variant;
+	QuirkProfile quirks;
+	unsigned int instructions_per_frame;
+
+	std::vector<unsigned char> data;
+	std::string disassembly;
+} CatalogEntry;
+
+/******************
+* RomCatalog
+*
+* Reads each ROM file once, and keeps its contents along with what is worked
+* out from them:  its hash, the chip it was written for, its quirk profile
+* (from a RomDatabase, if one is set), the number of instructions to run each
+* frame, and a disassembly.  The catalog can be saved to an index file, and
+* loaded again in one read, so ROMs which haven't changed since are never
+* read or disassembled again.
+*
+* The index is binary, with values stored little endian:  the magic and
+* version, the number of entries, then each entry's fields in the order of
+* CatalogEntry, strings and data prefixed by their length.
+******************/
+class RomCatalog
+{
+	private:
+		std::vector<CatalogEntry*> entries;
+		std::map<std::string, CatalogEntry*> by_filename;
+		std::map<uint64_t, CatalogEntry*> by_hash;
+
+		RomDatabase* rom_database;
+
+		// Whether entries were added or replaced since the index was loaded
+		bool changed;
+
+		void insert(CatalogEntry*);
+		void describe(CatalogEntry*);
+		void clear();
+
+	public:
+		RomCatalog();
+		~RomCatalog();
+
+		void set_rom_database(RomDatabase*);
+
+		bool load(const char*);
+		bool save(const char*);
+
+		const CatalogEntry* add(const char*);
+
+		const CatalogEntry* find(const std::string&);
+		const CatalogEntry* find(uint64_t);
+
+		unsigned int get_size();
+		bool is_changed();
+
+		static RomVariant detect_variant(const std::string&, const unsigned char*, unsigned int);
+		static unsigned int get_instructions_per_frame(RomVariant);
+		static const char* get_variant_name(RomVariant);
+		static std::string disassemble(const unsigned char*, unsigned int);
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __ROM_DATABASE_H__
+#define __ROM_DATABASE_H__
+
+#include "core/chip_variant.h"
+
+#include <map>
+#include <stdint.h>
+
+// Database of the programs distributed with the emulator
+#define DEFAULT_ROM_DATABASE		"programs/quirk_profiles.txt"
+
+/******************
+* RomDatabase
+*
+* Maps the hashes of ROMs to the quirk profile each needs.  The database is a
+* text file, with a line for each ROM:  its hash in hex, the name of its
+* profile, and optionally its name, which is ignored.  Blank lines and lines
+* starting with '#' are skipped.
+*
+*   # hash            profile  name
+*   0daf9351419594b1  schip    Blinky [Hans Christian Egeberg, 1991]
+******************/
+class RomDatabase
+{
+	private:
+		std::map<uint64_t, QuirkProfile> profiles;
+
+	public:
+		RomDatabase();
+
+		bool load(const char*);
+		void add(uint64_t, QuirkProfile);
+
+		bool find(uint64_t, QuirkProfile*);
+		bool find(const unsigned char*, unsigned int, QuirkProfile*);
+
+		unsigned int get_size();
+
+		static uint64_t hash(const unsigned char*, unsigned int);
+};
+
+#endif
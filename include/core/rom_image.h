@@ -0,0 +1,51 @@
+#ifndef __ROM_IMAGE_H__
+#define __ROM_IMAGE_H__
+
+#include "core/memory.h"
+
+#include <string>
+#include <vector>
+
+/******************
+* RomImage
+*
+* A ROM file mapped into memory, read only, so its contents are read straight
+* from the page cache without being copied into a buffer first.  The mapping
+* lasts until the image is closed or deleted.
+*
+* The size of the program is checked against the RAM of a memory once, when
+* it is loaded, and the whole program copied in with a single call.
+******************/
+class RomImage
+{
+	private:
+		std::string filename;
+
+		const unsigned char* data;
+		unsigned int size;
+
+		// Whether data is a mapping, rather than a (possibly empty) buffer
+		bool mapped;
+
+	public:
+		RomImage();
+		~RomImage();
+
+		bool open(const std::string&);
+		void close();
+
+		const std::string& get_filename();
+		const unsigned char* get_data();
+		unsigned int get_size();
+
+		bool fits(Memory*);
+		unsigned int load(Memory*);
+
+		// The same, for a program which has already been read
+		static bool fits(Memory*, unsigned int);
+		static unsigned int load(Memory*, const std::string&, const unsigned char*, unsigned int);
+
+		static bool find_roms(const std::string&, std::vector<std::string>&);
+};
+
+#endif
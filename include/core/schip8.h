@@ -3,30 +3,19 @@
 
 #include "core/chip8.h"
 
-enum GraphicMode {LORES, HIRES};
-
+/******************
+* SChip8
+*
+* A Chip-8 with the SCHIP 1.1 instructions.  The SCHIP operations and state
+* live in Chip8, so that the interpreter can be specialized for the SCHIP
+* instruction set, which this class selects.
+******************/
 class SChip8 : public Chip8
 {
 	protected:
-		// HP Registers
-		unsigned char hp_registers[8];
-
-		void _scroll_down(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _scroll_right(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _scroll_left(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _exit(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _enable_extended_screen(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _disable_extended_screen(unsigned short, unsigned char, unsigned char, unsigned char);
-
-		void _draw(unsigned short, unsigned char, unsigned char, unsigned char);
-
-		void _set_address_big_sprite(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _dump_register_rpl(unsigned short, unsigned char, unsigned char, unsigned char);
-		void _load_register_rpl(unsigned short, unsigned char, unsigned char, unsigned char);
-
-		void create_operation_map();
-
-		GraphicMode graphicMode;
+		void create_operation_map(OperationMap&);
+		unsigned short decode_opcode(unsigned short);
+		bool is_block_end(unsigned short);
 
 	public:
 		// Constructors and destructors
@@ -34,7 +23,10 @@ class SChip8 : public Chip8
 		SChip8(Memory*, Display*, Keyboard*);
 		SChip8(Memory*, Display*, Keyboard*, unsigned char);
 
-		void cycle();
+		void save(Snapshot*);
+		bool restore(Snapshot*);
+
+		Chip8* fork(Memory*, Display*, Keyboard*);
 };
 
 #endif
\ No newline at end of file
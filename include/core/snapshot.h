@@ -0,0 +1,79 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "core/memory.h"
+#include "core/display.h"
+
+#include <stdint.h>
+
+// Enough for all of memory, the largest display, and the state of the chip
+#define SNAPSHOT_CAPACITY		(MEMORY_SIZE + DISPLAY_MAX_SIZE * DISPLAY_MAX_SIZE / 8 + 0x400)
+
+#define SNAPSHOT_MAGIC			0x38504843		// "CHP8"
+#define SNAPSHOT_VERSION		3
+
+// Tags of the sections written by each component
+#define CHIP8_SECTION			'C'
+#define SCHIP8_SECTION			'S'
+#define MEMORY_SECTION			'M'
+#define DISPLAY_SECTION			'D'
+#define KEYBOARD_SECTION		'K'
+
+/******************
+* Snapshot
+*
+* A fixed size buffer holding the complete state of a computer, so a snapshot
+* can be saved and restored repeatedly without allocating.  The state of each
+* component is written into a tagged section, and values are stored little
+* endian, so snapshots can be written to a file and loaded on another
+* machine.
+*
+* Reading or writing past the end of the buffer, or of a section, marks the
+* snapshot as invalid rather than failing immediately, so components can
+* save and restore themselves without checking every value.
+******************/
+class Snapshot
+{
+	private:
+		unsigned char data[SNAPSHOT_CAPACITY];
+
+		unsigned int size;
+		unsigned int position;
+
+		// Start of the section being written, or end of the section being read
+		unsigned int section;
+
+		bool valid;
+
+	public:
+		Snapshot();
+
+		// Start writing a new snapshot, or reading this one from the start
+		void begin();
+		bool open();
+
+		bool is_valid();
+
+		// Access to the raw snapshot, e.g., to save it to a file
+		const unsigned char* get_data();
+		unsigned int get_size();
+		bool set_data(const unsigned char*, unsigned int);
+		uint64_t get_hash();
+
+		void begin_section(unsigned char);
+		void end_section();
+		bool open_section(unsigned char);
+		bool close_section();
+
+		void write_byte(unsigned char);
+		void write_short(unsigned short);
+		void write_word(uint64_t);
+		void write_bytes(const unsigned char*, unsigned int);
+
+		unsigned char read_byte();
+		unsigned short read_short();
+		uint64_t read_word();
+		void read_bytes(unsigned char*, unsigned int);
+};
+
+#endif
@@ -99,6 +99,9 @@ class Disassembler
 		void print();
 		std::string decompile_command(Code);
 		void trace();
+
+		std::string disassemble(unsigned short, unsigned short);
+		const char* get_mnemonic(unsigned short);
 };
 
 #endif
\ No newline at end of file
@@ -17,6 +17,10 @@ class GladeGui : public ChipListener
 		GtkWidget* address_register_value;
 		GtkWidget* memory_display;
 
+		// Text of the memory display, of which only the lines written since
+		// the last fill are redrawn
+		char memory_text[MEMORY_TEXT_LENGTH + 1];
+
 		void link_widgets(GtkBuilder*);
 		void link_keyboard(GtkBuilder*);
 
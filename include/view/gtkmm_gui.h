@@ -36,6 +36,10 @@ class GtkmmGui : public ChipListener
 
 		std::map <Gtk::Label*, std::string> stale_values;
 
+		// Text of the memory display, of which only the lines written since
+		// the last update are redrawn
+		char memory_text[MEMORY_TEXT_LENGTH + 1];
+
 		void setup_labels(Glib::RefPtr<Gtk::Builder>);
 		void setup_keyboard(Glib::RefPtr<Gtk::Builder>);
 		void setup_menu(Glib::RefPtr<Gtk::Builder>);
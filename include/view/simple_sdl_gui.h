@@ -3,11 +3,14 @@
 
 #include "core/computer.h"
 #include "core/chip_listener.h"
+#include "core/frame_buffer.h"
 
 #include <SDL2/SDL.h>
 
+#include <chrono>
+
+// How often events are handled, and the screen redrawn if it has changed
 const int SCREEN_FPS = 100;
-const int SCREEN_TICKS_PER_FRAME = 1000 / SCREEN_FPS;
 
 class SimpleSDLGui : public ChipListener
 {
@@ -44,6 +47,26 @@ class SimpleSDLGui : public ChipListener
 		SDL_Surface* screenSurface;
 		SDL_Renderer* renderer;
 
+		// Frames are expanded into a streaming texture of one texel per
+		// pixel, which is scaled to the screen in one copy
+		SDL_Texture* screen_texture;
+		unsigned int texture_width;
+		unsigned int texture_height;
+
+		Uint32 foreground_color;
+		Uint32 background_color;
+
+		// The eight texels of each byte of packed pixels
+		Uint32 byte_texels[256][8];
+
+		// Present the screen in step with the monitor's refresh
+		bool vsync;
+
+		// The screen is only redrawn when the display has changed since it
+		// was last drawn, or the window needs it
+		unsigned long drawn_generation;
+		bool redraw;
+
 		// Keyboard mapping
 		SDL_Keycode Key0 = SDLK_x;
 		SDL_Keycode Key1 = SDLK_1;
@@ -62,8 +85,12 @@ class SimpleSDLGui : public ChipListener
 		SDL_Keycode KeyE = SDLK_f;
 		SDL_Keycode KeyF = SDLK_v;
 
-		void draw();
-		void draw_screen(int, int, int, int);
+		// Held down to run backwards through the rewind history
+		SDL_Keycode KeyRewind = SDLK_BACKSPACE;
+
+		void draw(const Frame*);
+		void draw_screen(const Frame*, int, int, int, int);
+		bool update_screen_texture(const Frame*);
 
 	public:
 		SimpleSDLGui(Computer*, int, char**);
@@ -74,6 +101,8 @@ class SimpleSDLGui : public ChipListener
 		void build();
 		void run();
 
+		void set_vsync(bool);
+
 		// Chip-8 Listener
 		void update_register(unsigned char, unsigned char);
 		void update_program_counter(unsigned short);
@@ -8,10 +8,8 @@
 
 #include <iostream>
 #include <fstream>
-#include <stdlib.h>
 #include <time.h>
-
-#define CALL_STACK_SIZE		16
+#include <string.h>
 
 /************
 *
@@ -24,15 +22,41 @@ Chip8::Chip8()
 	keyboard = new Keyboard();
 	display = new Display();
 
-	call_stack = new unsigned short[CALL_STACK_SIZE];
+	call_stack_size = CALL_STACK_SIZE;
+	call_stack = new unsigned short[call_stack_size];
+	listener_stack = new unsigned short[call_stack_size];
 
 	refresh=false;
+	gui = NULL;
+	memset(&changes, 0, sizeof(changes));
+	memset(listener_stack, 0, call_stack_size * sizeof(unsigned short));
+	listener_display_generation = 0;
+	halted = false;
+
+	engine = STEP_ENGINE;
+	recompiler = NULL;
+	recompiled_blocks = NULL;
+	verify_recompiler = false;
+
+	profiler = NULL;
+
+	graphicMode = LORES;
+	memset(hp_registers, 0, sizeof(hp_registers));
 
 	// Seed a random number generator
-	srand(time(NULL));
+	set_seed(time(NULL));
+
+	// Build the dispatch table from the opcode-to-operation map
+	instruction_cache = NULL;
+	block_lengths = NULL;
+	create_operation_table();
 
-	// Populate the opcode-to-operation map
-	create_operation_map();
+	instruction_set = CHIP8_INSTRUCTIONS;
+	quirks = DEFAULT_QUIRKS;
+	select_interpreter();
+
+	// Keep the instruction cache up to date with writes to memory
+	memory->add_listener(this);
 }
 
 
@@ -46,15 +70,41 @@ Chip8::Chip8(Memory* _memory, Display* _display, Keyboard* _keyboard)
 	keyboard = _keyboard;
 	display = _display;
 
-	call_stack = new unsigned short[CALL_STACK_SIZE];
+	call_stack_size = CALL_STACK_SIZE;
+	call_stack = new unsigned short[call_stack_size];
+	listener_stack = new unsigned short[call_stack_size];
 
 	refresh=false;
+	gui = NULL;
+	memset(&changes, 0, sizeof(changes));
+	memset(listener_stack, 0, call_stack_size * sizeof(unsigned short));
+	listener_display_generation = 0;
+	halted = false;
+
+	engine = STEP_ENGINE;
+	recompiler = NULL;
+	recompiled_blocks = NULL;
+	verify_recompiler = false;
+
+	profiler = NULL;
+
+	graphicMode = LORES;
+	memset(hp_registers, 0, sizeof(hp_registers));
 
 	// Seed a random number generator
-	srand(time(NULL));
+	set_seed(time(NULL));
+
+	// Build the dispatch table from the opcode-to-operation map
+	instruction_cache = NULL;
+	block_lengths = NULL;
+	create_operation_table();
 
-	// Populate the opcode-to-operation map
-	create_operation_map();
+	instruction_set = CHIP8_INSTRUCTIONS;
+	quirks = DEFAULT_QUIRKS;
+	select_interpreter();
+
+	// Keep the instruction cache up to date with writes to memory
+	memory->add_listener(this);
 }
 
 
@@ -62,30 +112,68 @@ Chip8::Chip8(Memory* _memory, Display* _display, Keyboard* _keyboard)
 *
 * Create a Chip-8 with provided components, allowing user to override default call stack size
 ************/
-Chip8::Chip8(Memory* _memory, Display* _display, Keyboard* _keyboard, unsigned char call_stack_size)
+Chip8::Chip8(Memory* _memory, Display* _display, Keyboard* _keyboard, unsigned char _call_stack_size)
 {
 	memory = _memory;
 	keyboard = _keyboard;
 	display = _display;
 
+	call_stack_size = _call_stack_size;
 	call_stack = new unsigned short[call_stack_size];
+	listener_stack = new unsigned short[call_stack_size];
 
 	refresh=false;
+	gui = NULL;
+	memset(&changes, 0, sizeof(changes));
+	memset(listener_stack, 0, call_stack_size * sizeof(unsigned short));
+	listener_display_generation = 0;
+	halted = false;
+
+	engine = STEP_ENGINE;
+	recompiler = NULL;
+	recompiled_blocks = NULL;
+	verify_recompiler = false;
+
+	profiler = NULL;
+
+	graphicMode = LORES;
+	memset(hp_registers, 0, sizeof(hp_registers));
 
 	// Seed a random number generator
-	srand(time(NULL));
+	set_seed(time(NULL));
 
-	// Populate the opcode-to-operation map
-	create_operation_map();
+	// Build the dispatch table from the opcode-to-operation map
+	instruction_cache = NULL;
+	block_lengths = NULL;
+	create_operation_table();
+
+	instruction_set = CHIP8_INSTRUCTIONS;
+	quirks = DEFAULT_QUIRKS;
+	select_interpreter();
+
+	// Keep the instruction cache up to date with writes to memory
+	memory->add_listener(this);
 }
 
 
-void Chip8::create_operation_map()
+Chip8::~Chip8()
 {
-	// On the off chance the map is full, clear it out
-	operation_map.clear();
+	delete [] call_stack;
+	delete [] listener_stack;
+	delete [] instruction_cache;
+	delete [] block_lengths;
+
+	if(recompiler)
+	{
+		delete recompiler;
+		delete [] recompiled_blocks;
+	}
+}
 
-	// Now map all the opcodes to the corresponding functions
+
+void Chip8::create_operation_map(OperationMap& operation_map)
+{
+	// Map all the opcodes to the corresponding functions
 	operation_map.insert(std::make_pair(0x00E0, &Chip8::_clear_screen));
 	operation_map.insert(std::make_pair(0x00EE, &Chip8::_return));
 	operation_map.insert(std::make_pair(0x0000, &Chip8::_system_call));
@@ -129,6 +217,321 @@ void Chip8::create_operation_map()
 }
 
 
+/*************
+* create_operation_table()
+*
+* Decode every opcode once, and store the result in a flat dispatch table, so
+* that cycle() does not need to mask the opcode and search the operation map.
+* Called again by the constructor of each subclass which adds operations.
+************/
+void Chip8::create_operation_table()
+{
+	// The map is only needed while building the table, so it isn't kept
+	OperationMap operation_map;
+	create_operation_map(operation_map);
+
+	operation_list.clear();
+	operation_list.push_back(NULL);
+
+	// Invalid opcodes end a block, so that they are reported immediately
+	operation_ends_block.clear();
+	operation_ends_block.push_back(true);
+
+	for(unsigned short i=0; i<0x1000; i++)
+	{
+		// Rebuild an opcode from the first nybble and last byte
+		unsigned short opcode = ((i & 0x0F00) << 4) | (i & 0x00FF);
+		unsigned short opnum = decode_opcode(opcode);
+
+		// Opcodes not in the operation map are invalid
+		if(operation_map.find(opnum) == operation_map.end())
+		{
+			operation_table[i] = 0;
+			continue;
+		}
+
+		Operation operation = operation_map[opnum];
+
+		// Find the operation in the list, adding it if it isn't there already
+		unsigned char index = 1;
+		while(index < operation_list.size() && operation_list[index] != operation)
+		{
+			index++;
+		}
+
+		if(index == operation_list.size())
+		{
+			operation_list.push_back(operation);
+			operation_ends_block.push_back(is_block_end(opnum));
+		}
+
+		operation_table[i] = index;
+	}
+
+	// Any previously decoded instructions refer to the old table
+	flush_instruction_cache();
+}
+
+
+/*************
+* decode_instruction()
+*
+* Fetch the opcode at the given address, look up its operation, and split
+* out the operands.
+************/
+void Chip8::decode_instruction(unsigned short address, DecodedInstruction* instruction)
+{
+	// The opcode takes two bytes in memory, stored big-endian
+	unsigned short opcode = (memory->fetch(address) << 8) | (memory->fetch(address + 1));
+
+	instruction->opcode = opcode;
+	instruction->operation = operation_table[((opcode & 0xF000) >> 4) | (opcode & 0x00FF)];
+
+	// Pull out all possible variables from the opcode
+	instruction->address = 		(unsigned short) (opcode & 0x0FFF);			// 12-bit value
+	instruction->register_x = 	(unsigned char) ((opcode & 0x0F00) >> 8);	// 2nd nybble
+	instruction->register_y = 	(unsigned char) ((opcode & 0x00F0) >> 4);	// 3rd nybble
+	instruction->value =		(unsigned char) (opcode & 0x00FF);			// Last byte used as value
+
+	instruction->decoded = true;
+}
+
+
+/*************
+* allocate_instruction_cache()
+*
+* Allocate the instruction cache and block lengths, and the compiled blocks
+* if using the recompiler.  Called before the chip first executes.
+************/
+void Chip8::allocate_instruction_cache()
+{
+	instruction_cache = new DecodedInstruction[INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START];
+	block_lengths = new unsigned char[INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START];
+
+	if(engine == RECOMPILER_ENGINE)
+	{
+		set_engine(RECOMPILER_ENGINE);
+	}
+
+	flush_instruction_cache();
+}
+
+
+/*************
+* flush_instruction_cache()
+*
+* Mark every instruction in the cache as needing to be decoded again.
+************/
+void Chip8::flush_instruction_cache()
+{
+	if(!instruction_cache)
+	{
+		return;
+	}
+
+	for(int i=0; i<INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START; i++)
+	{
+		instruction_cache[i].decoded = false;
+		block_lengths[i] = 0;
+	}
+
+	clear_recompiled_blocks();
+}
+
+
+/*************
+* memory_written()
+*
+* Invalidate any cached instruction that overlaps the written address, and
+* note the write for the listener.
+************/
+void Chip8::memory_written(unsigned short address)
+{
+	memory_written(address, 1);
+}
+
+
+/*************
+* memory_written(unsigned short address, unsigned int size)
+*
+* Invalidate any cached instruction that overlaps the run of bytes written,
+* and note the write for the listener.
+************/
+void Chip8::memory_written(unsigned short address, unsigned int size)
+{
+	int end = address + size;
+
+	// An instruction starting in the run, or the byte before, overlaps it
+	for(int i = address - 1; instruction_cache && i < end; i++)
+	{
+		if(i >= INSTRUCTION_CACHE_START && i < INSTRUCTION_CACHE_END)
+		{
+			instruction_cache[i - INSTRUCTION_CACHE_START].decoded = false;
+		}
+	}
+
+	// Any block that could contain the run needs to be rebuilt
+	for(int i = address - 2*MAX_BLOCK_LENGTH; instruction_cache && i < end; i++)
+	{
+		if(i >= INSTRUCTION_CACHE_START && i < INSTRUCTION_CACHE_END)
+		{
+			block_lengths[i - INSTRUCTION_CACHE_START] = 0;
+
+			if(recompiled_blocks)
+			{
+				recompiled_blocks[i - INSTRUCTION_CACHE_START].function = NULL;
+				recompiled_blocks[i - INSTRUCTION_CACHE_START].executions = 0;
+				recompiled_blocks[i - INSTRUCTION_CACHE_START].uncompilable = false;
+			}
+		}
+	}
+
+	// Keep track of the memory written, for the listener
+	if(gui)
+	{
+		if(!changes.memory_changed)
+		{
+			changes.memory_changed = true;
+			changes.memory_start = address;
+			changes.memory_end = end;
+		}
+		else
+		{
+			if(address < changes.memory_start)
+			{
+				changes.memory_start = address;
+			}
+			if(end > changes.memory_end)
+			{
+				changes.memory_end = end;
+			}
+		}
+	}
+}
+
+
+/*************
+* memory_restored()
+*
+* All of memory has changed, so nothing in the instruction cache can be
+* trusted.
+************/
+void Chip8::memory_restored()
+{
+	flush_instruction_cache();
+
+	if(gui)
+	{
+		changes.memory_changed = true;
+		changes.memory_start = 0;
+		changes.memory_end = MEMORY_SIZE;
+	}
+}
+
+
+/*************
+* is_block_end()
+*
+* Check if the operation for the opnum may change the program counter (jumps,
+* calls, returns and skips), or needs to be seen by the rest of the system
+* before continuing (draw and waiting for a key).  These operations end a
+* basic block.
+************/
+bool Chip8::is_block_end(unsigned short opnum)
+{
+	switch(opnum)
+	{
+		case 0x00EE:		// Return
+		case 0x1000:		// Jump
+		case 0x2000:		// Call
+		case 0x3000:		// Skip instructions
+		case 0x4000:
+		case 0x5000:
+		case 0x9000:
+		case 0xE09E:
+		case 0xE0A1:
+		case 0xB000:		// Jump with offset
+		case 0xD000:		// Draw
+		case 0xF00A:		// Wait for a key
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+/*************
+* build_block()
+*
+* Determine the length of the basic block starting at the given slot of the
+* instruction cache, decoding instructions as needed.  The block ends with the
+* first instruction that may change the program counter.
+************/
+void Chip8::build_block(unsigned short slot)
+{
+	unsigned char length = 0;
+	bool block_ended = false;
+
+	while(!block_ended && length < MAX_BLOCK_LENGTH && slot < INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START)
+	{
+		DecodedInstruction* instruction = &instruction_cache[slot];
+
+		if(!instruction->decoded)
+		{
+			decode_instruction(slot + INSTRUCTION_CACHE_START, instruction);
+		}
+
+		block_ended = operation_ends_block[instruction->operation];
+
+		length++;
+		slot += 2;
+	}
+
+	block_lengths[slot - 2*length] = length;
+}
+
+
+/*************
+* decode_opcode()
+*
+* Mask the opcode down to the key used in the operation map.  Only the
+* first nybble and last byte are examined.
+************/
+unsigned short Chip8::decode_opcode(unsigned short opcode)
+{
+	// Decode the opcode and act accordingly
+	// opcodes are organized roughly by first nybble
+	unsigned short opnum = opcode & 0xF000;
+
+	// Opcode prefix 0x0000 may also refer to 0x00E0 or 0x00EE, check if this
+	// is the case
+	if(opnum == 0x0000)
+	{
+		if((opcode & 0x00FF) == 0x00E0 || (opcode & 0x00FF) == 0x00EE)
+		{
+			opnum = opcode & 0xF0FF;
+		}
+	}
+
+	// Opcode prefix 0x8000 also relies on the last nybble
+	// NOTE:  Check if this is critical for 0x5000 and 0x9000 as well.
+	//        Do these operations necessarily need to end in 0?
+	if((opnum == 0x5000) || (opnum == 0x8000) || (opnum==0x9000))
+	{
+		opnum = opcode & 0xF00F;
+	}
+
+	// Opcode prefix 0xE000 and 0xF000 rely on the last byte as well
+	if((opnum == 0xE000) || (opnum == 0xF000))
+	{
+		opnum = opcode & 0xF0FF;
+	}
+
+	return opnum;
+}
+
+
 
 /*************
 * reset()
@@ -149,9 +552,13 @@ void Chip8::reset()
 	sound_timer = 0x00;
 
 
-	// Set the stack pointer to 0x00
-	// NOTE: Should the call stack be flushed / set to zero?
+	// Set the stack pointer to 0x00, and flush the call stack, so a reset
+	// chip is always in the same state
 	stack_pointer = 0x00;
+	for(int i=0; i<call_stack_size; i++)
+	{
+		call_stack[i] = 0x0000;
+	}
 
 
 	// Set the address register to 0x00
@@ -161,22 +568,11 @@ void Chip8::reset()
 	// Set the program counter to the start of the program memory
 	program_counter = 0x200;
 
+	halted = false;
 
-	// Update listeners to reflect the changes
-	if(gui)
-	{
-		for(int i=0; i<0x10; i++)
-		{
-			gui->update_register(i, 0x00);
-		}
 
-		gui->update_delay_timer(0x00);
-		gui->update_sound_timer(0x00);
-		gui->update_stack_pointer(0x00);
-		gui->update_address_register(0x00);
-		gui->update_program_counter(0x200);
-		gui->update_stack(call_stack, 0x00, CALL_STACK_SIZE);
-	}
+	// Update listeners to reflect the changes
+	update_listener();
 }
 
 	
@@ -184,8 +580,7 @@ void Chip8::add_listener(ChipListener* _gui)
 {
 	gui = _gui;
 
-	gui->update_stack(call_stack, stack_pointer, CALL_STACK_SIZE);
-	gui->update_memory();
+	refresh_listener();
 }
 
 
@@ -194,7 +589,6 @@ void Chip8::cycle_delay()
 	if(delay_timer > 0)
 	{
 		delay_timer--;
-		gui->update_delay_timer(delay_timer);
 	}
 }
 
@@ -204,10 +598,330 @@ void Chip8::cycle_sound()
 	if(sound_timer > 0)
 	{
 		sound_timer--;
-		gui->update_sound_timer(sound_timer);
 	}
 }
 
+/*************
+* get_interpreter()
+*
+* The interpreter specialized for the variant.  Each variant gets its own
+* copy of every loop below, with the variant's switch inlined into it.
+************/
+template<class Variant>
+const Chip8::Interpreter* Chip8::get_interpreter()
+{
+	static const Interpreter specialized = {
+		&Chip8::step<Variant, NoProfiling>,
+		&Chip8::interpret<Variant, NoProfiling>,
+		&Chip8::interpret<Variant, InstructionProfiling>,
+		&Chip8::execute_blocks<Variant>,
+		&Chip8::execute_recompiled<Variant>
+	};
+
+	return &specialized;
+}
+
+
+/*************
+* select_interpreter()
+*
+* Pick the interpreter for the chip's instruction set and quirks.  Must be
+* called again whenever either changes.
+************/
+void Chip8::select_interpreter()
+{
+	bool super_chip = instruction_set == SCHIP8_INSTRUCTIONS;
+
+	switch(quirks)
+	{
+		case COSMAC_QUIRKS:
+			interpreter = super_chip ? get_interpreter<ChipVariant<true, CosmacQuirks> >()
+			                         : get_interpreter<ChipVariant<false, CosmacQuirks> >();
+			break;
+
+		case SCHIP_QUIRKS:
+			interpreter = super_chip ? get_interpreter<ChipVariant<true, SChipQuirks> >()
+			                         : get_interpreter<ChipVariant<false, SChipQuirks> >();
+			break;
+
+		default:
+			interpreter = super_chip ? get_interpreter<SChip8Variant>()
+			                         : get_interpreter<Chip8Variant>();
+			break;
+	}
+}
+
+
+/*************
+* set_quirks(QuirkProfile quirks)
+*
+* Switch to the interpreter for the quirk profile.  The quirks are resolved
+* here, once, so the interpreter never checks them.
+************/
+void Chip8::set_quirks(QuirkProfile _quirks)
+{
+	if(_quirks >= NUM_QUIRK_PROFILES)
+	{
+		std::cout << "ERROR:  Unknown quirk profile " << _quirks << std::endl;
+		return;
+	}
+
+	quirks = _quirks;
+	select_interpreter();
+
+	// Compiled blocks may depend on the quirks
+	clear_recompiled_blocks();
+}
+
+
+QuirkProfile Chip8::get_quirks()
+{
+	return quirks;
+}
+
+
+/*************
+* execute_instruction()
+*
+* Execute a decoded instruction.  The operation is found by a switch on the
+* opcode, specialized for the variant, so the handlers can be inlined, and
+* instructions the variant doesn't have, or quirks it doesn't use, cost
+* nothing.  Whether the opcode is valid is already known from the dispatch
+* table.
+************/
+template<class Variant>
+inline void Chip8::execute_instruction(const DecodedInstruction* instruction)
+{
+	// The handler may overwrite the instruction, so take a copy of the operands
+	unsigned short opcode = instruction->opcode;
+	unsigned short address = instruction->address;
+	unsigned char register_x = instruction->register_x;
+	unsigned char register_y = instruction->register_y;
+	unsigned char value = instruction->value;
+
+	if(instruction->operation == 0)
+	{
+		_invalid_opcode(opcode);
+		return;
+	}
+
+	switch(opcode >> 12)
+	{
+		case 0x0:
+			if(Variant::SUPER_CHIP)
+			{
+				if((value & 0xF0) == 0xC0)
+				{
+					_scroll_down(address, register_x, register_y, value);
+					return;
+				}
+
+				switch(value)
+				{
+					case 0xFB:	_scroll_right(address, register_x, register_y, value);				return;
+					case 0xFC:	_scroll_left(address, register_x, register_y, value);				return;
+					case 0xFD:	_exit(address, register_x, register_y, value);						return;
+					case 0xFE:	_disable_extended_screen(address, register_x, register_y, value);	return;
+					case 0xFF:	_enable_extended_screen(address, register_x, register_y, value);	return;
+				}
+			}
+
+			switch(value)
+			{
+				case 0xE0:	_clear_screen(address, register_x, register_y, value);		break;
+				case 0xEE:	_return(address, register_x, register_y, value);			break;
+				default:	_system_call(address, register_x, register_y, value);		break;
+			}
+			break;
+
+		case 0x1:	_jump(address, register_x, register_y, value);								break;
+		case 0x2:	_call(address, register_x, register_y, value);								break;
+		case 0x3:	_skip_equal_register_value(address, register_x, register_y, value);			break;
+		case 0x4:	_skip_not_equal_register_value(address, register_x, register_y, value);		break;
+		case 0x5:	_skip_equal_register_register(address, register_x, register_y, value);		break;
+		case 0x6:	_assign_register_value(address, register_x, register_y, value);				break;
+		case 0x7:	_add_register_value(address, register_x, register_y, value);				break;
+
+		case 0x8:
+			switch(opcode & 0x000F)
+			{
+				case 0x0:	_assign_register_register(address, register_x, register_y, value);				break;
+				case 0x1:	_or(address, register_x, register_y, value);									break;
+				case 0x2:	_and(address, register_x, register_y, value);									break;
+				case 0x3:	_xor(address, register_x, register_y, value);									break;
+				case 0x4:	_add_register_register(address, register_x, register_y, value);					break;
+				case 0x5:	_subtract_register_register(address, register_x, register_y, value);			break;
+				case 0x7:	_subtract_negative_register_register(address, register_x, register_y, value);	break;
+
+				case 0x6:
+					if(Variant::SHIFT_VY)
+					{
+						registers[register_x] = registers[register_y];
+					}
+					_shift_right(address, register_x, register_y, value);
+					break;
+
+				case 0xE:
+					if(Variant::SHIFT_VY)
+					{
+						registers[register_x] = registers[register_y];
+					}
+					_shift_left(address, register_x, register_y, value);
+					break;
+			}
+			break;
+
+		case 0x9:	_skip_not_equal_register_register(address, register_x, register_y, value);	break;
+		case 0xA:	_set_address_register(address, register_x, register_y, value);				break;
+
+		case 0xB:
+			if(Variant::JUMP_VX)
+			{
+				program_counter = address + registers[register_x];
+			}
+			else
+			{
+				_jump_offset(address, register_x, register_y, value);
+			}
+			break;
+
+		case 0xC:	_random(address, register_x, register_y, value);							break;
+
+		case 0xD:
+			if(Variant::SUPER_CHIP)
+			{
+				draw_extended_sprite<Variant::CLIP_SPRITES>(register_x, register_y, value);
+			}
+			else
+			{
+				draw_sprite<Variant::CLIP_SPRITES>(register_x, register_y, value);
+			}
+			break;
+
+		case 0xE:
+			if(value == 0x9E)
+			{
+				_skip_key_pressed(address, register_x, register_y, value);
+			}
+			else
+			{
+				_skip_key_not_pressed(address, register_x, register_y, value);
+			}
+			break;
+
+		case 0xF:
+			switch(value)
+			{
+				case 0x07:	_get_delay_timer(address, register_x, register_y, value);		break;
+				case 0x0A:	_get_key(address, register_x, register_y, value);				break;
+				case 0x15:	_set_delay_timer(address, register_x, register_y, value);		break;
+				case 0x18:	_set_sound_timer(address, register_x, register_y, value);		break;
+				case 0x1E:	_add_address_register(address, register_x, register_y, value);	break;
+				case 0x29:	_set_address_sprite(address, register_x, register_y, value);	break;
+				case 0x33:	_store_bcd(address, register_x, register_y, value);				break;
+
+				case 0x55:
+				case 0x65:
+				{
+					unsigned short start = address_register;
+
+					if(value == 0x55)
+					{
+						_dump_register(address, register_x, register_y, value);
+					}
+					else
+					{
+						_load_register(address, register_x, register_y, value);
+					}
+
+					if(Variant::LOAD_STORE_KEEPS_I)
+					{
+						address_register = start;
+					}
+					break;
+				}
+
+				case 0x30:
+					if(Variant::SUPER_CHIP)
+					{
+						_set_address_big_sprite(address, register_x, register_y, value);
+					}
+					break;
+
+				case 0x75:
+					if(Variant::SUPER_CHIP)
+					{
+						_dump_register_rpl(address, register_x, register_y, value);
+					}
+					break;
+
+				case 0x85:
+					if(Variant::SUPER_CHIP)
+					{
+						_load_register_rpl(address, register_x, register_y, value);
+					}
+					break;
+			}
+			break;
+	}
+}
+
+
+/*************
+* step()
+*
+* Execute the instruction at the program counter, and inform the profiling
+* policy.  With NoProfiling, this compiles to the same code as if there was
+* no profiling at all.
+************/
+template<class Variant, class Profiling>
+inline void Chip8::step()
+{
+	// Get the decoded instruction at the program counter, decoding it if it
+	// isn't in the cache
+	DecodedInstruction uncached;
+	DecodedInstruction* instruction = &uncached;
+	uncached.decoded = false;
+
+	if(program_counter >= INSTRUCTION_CACHE_START && program_counter < INSTRUCTION_CACHE_END)
+	{
+		instruction = &instruction_cache[program_counter - INSTRUCTION_CACHE_START];
+	}
+	if(!instruction->decoded)
+	{
+		decode_instruction(program_counter, instruction);
+	}
+
+	// Increment the program counter past the two byte opcode
+	unsigned short address = program_counter;
+	program_counter += 2;
+
+	// The handler may overwrite the cached instruction
+	unsigned short opcode = instruction->opcode;
+
+	execute_instruction<Variant>(instruction);
+
+	Profiling::executed(profiler, address, opcode, program_counter);
+}
+
+
+/*************
+* interpret()
+*
+* Step through a number of instructions, returning the number executed.
+************/
+template<class Variant, class Profiling>
+unsigned int Chip8::interpret(unsigned int num_instructions)
+{
+	for(unsigned int i=0; i<num_instructions; i++)
+	{
+		step<Variant, Profiling>();
+	}
+
+	return num_instructions;
+}
+
+
 /*************
 * cycle()
 *
@@ -215,62 +929,407 @@ void Chip8::cycle_sound()
 ************/
 void Chip8::cycle()
 {
-	// Get the opcode from memory, and increment the program counter
-	// The opcode takes two bytes in memory, stored big-endian
-	unsigned short opcode = (memory->fetch(program_counter) << 8) | (memory->fetch(program_counter + 1));
-	program_counter += 2;
+	if(!instruction_cache)
+	{
+		allocate_instruction_cache();
+	}
 
-	gui->update_program_counter(program_counter);
-	
-	// Pull out all possible variables from the opcode
-	unsigned short address = 	(unsigned short) (opcode & 0x0FFF);			// 12-bit value
-	unsigned char register_x = 	(unsigned char) ((opcode & 0x0F00) >> 8);	// 2nd nybble
-	unsigned char register_y = 	(unsigned char) ((opcode & 0x00F0) >> 4);	// 3rd nybble
-	unsigned char value =		(unsigned char) (opcode & 0x00FF);			// Last byte used as value
+	(this->*interpreter->step)();
+}
 
-	// Method to be called
-	void (Chip8::* operation) (unsigned short, unsigned char, unsigned char, unsigned char) = NULL;
 
-	// Decode the opcode and act accordingly
-	// opcodes are organized roughly by first nybble
-	unsigned short opnum = opcode & 0xF000;
+/*************
+* execute()
+*
+* Execute a number of instructions with the selected engine, returning the
+* number of instructions executed.  The engines are specialized for the
+* variant, so there is one indirect call here, rather than one for each
+* instruction.
+************/
+unsigned int Chip8::execute(unsigned int num_instructions)
+{
+	if(!instruction_cache)
+	{
+		allocate_instruction_cache();
+	}
 
-	// Opcode prefix 0x0000 may also refer to 0x00E0 or 0x00EE, check if this
-	// is the case
-	if(opnum == 0x0000)
+	// Every instruction is counted when profiling, so blocks and compiled
+	// code, which run several at once, aren't used
+	if(profiler)
 	{
-		if((opcode & 0x00FF) == 0x00E0 || (opcode & 0x00FF) == 0x00EE)
+		return (this->*interpreter->interpret_profiled)(num_instructions);
+	}
+
+	if(engine == BLOCK_ENGINE)
+	{
+		return (this->*interpreter->execute_blocks)(num_instructions);
+	}
+
+	if(engine == RECOMPILER_ENGINE)
+	{
+		return (this->*interpreter->execute_recompiled)(num_instructions);
+	}
+
+	return (this->*interpreter->interpret)(num_instructions);
+}
+
+
+void Chip8::set_engine(ExecutionEngine _engine)
+{
+	// The recompiler is set up with the rest of the caches, if they haven't
+	// been allocated yet
+	if(_engine == RECOMPILER_ENGINE && !instruction_cache)
+	{
+		engine = _engine;
+		return;
+	}
+
+	if(_engine == RECOMPILER_ENGINE && !recompiler)
+	{
+		recompiler = new Recompiler();
+		recompiled_blocks = new RecompiledBlock[INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START];
+		clear_recompiled_blocks();
+	}
+
+	// Without executable memory, fall back to the block engine
+	if(_engine == RECOMPILER_ENGINE && !recompiler->is_available())
+	{
+		std::cout << "Recompiler not available, using block engine" << std::endl;
+		_engine = BLOCK_ENGINE;
+	}
+
+	engine = _engine;
+}
+
+
+void Chip8::set_recompiler_verification(bool verify)
+{
+	verify_recompiler = verify;
+}
+
+
+/*************
+* set_profiler(Profiler* profiler)
+*
+* Count every instruction executed in the profiler, or stop if NULL.  While
+* profiling, instructions are always stepped one at a time, whatever the
+* engine.  Forks of the chip aren't profiled.
+************/
+void Chip8::set_profiler(Profiler* _profiler)
+{
+	profiler = _profiler;
+}
+
+
+Profiler* Chip8::get_profiler()
+{
+	return profiler;
+}
+
+
+/*************
+* execute_blocks()
+*
+* Execute instructions a basic block at a time.  Each block is a run of
+* cached instructions, which are called back to back without checking the
+* program counter.  If memory in the block is written while it executes, the
+* rest of the block is abandoned and rebuilt on the next pass.  Outside of
+* the instruction cache, instructions are stepped one at a time.
+************/
+template<class Variant>
+unsigned int Chip8::execute_blocks(unsigned int num_instructions)
+{
+	unsigned int executed = 0;
+
+	while(executed < num_instructions)
+	{
+		if(program_counter < INSTRUCTION_CACHE_START || program_counter >= INSTRUCTION_CACHE_END)
 		{
-			opnum = opcode & 0xF0FF;
+			step<Variant, NoProfiling>();
+			executed++;
+			continue;
+		}
+
+		unsigned short slot = program_counter - INSTRUCTION_CACHE_START;
+
+		if(block_lengths[slot] == 0)
+		{
+			build_block(slot);
+		}
+
+		// Don't run past the requested number of instructions
+		unsigned int length = block_lengths[slot];
+		if(length > num_instructions - executed)
+		{
+			length = num_instructions - executed;
+		}
+
+		DecodedInstruction* instruction = &instruction_cache[slot];
+
+		for(unsigned int i=0; i<length; i++)
+		{
+			// Stop if memory under the instruction has been written
+			if(!instruction->decoded)
+			{
+				break;
+			}
+
+			program_counter += 2;
+
+			execute_instruction<Variant>(instruction);
+
+			executed++;
+			instruction += 2;
 		}
 	}
 
-	// Opcode prefix 0x8000 also relies on the last nybble
-	// NOTE:  Check if this is critical for 0x5000 and 0x9000 as well.
-	//        Do these operations necessarily need to end in 0?
-	if((opnum == 0x5000) || (opnum == 0x8000) || (opnum==0x9000))
+	return executed;
+}
+
+
+/*************
+* is_recompilable()
+*
+* Check if the recompiler can translate the instruction.  The operation in
+* the dispatch table must be the Chip8 operation that the recompiler
+* reproduces, so subclasses that override it are always interpreted, as are
+* shifts for variants that shift VY.
+************/
+template<class Variant>
+bool Chip8::is_recompilable(DecodedInstruction* instruction)
+{
+	unsigned short opcode = instruction->opcode;
+	Operation operation = operation_list[instruction->operation];
+
+	if(!Recompiler::can_compile(opcode))
 	{
-		opnum = opcode & 0xF00F;
+		return false;
 	}
 
-	// Opcode prefix 0xE000 and 0xF000 rely on the last byte as well
-	if((opnum == 0xE000) || (opnum == 0xF000))
+	switch(opcode & 0xF000)
 	{
-		opnum = opcode & 0xF0FF;
+		case 0x6000:	return operation == &Chip8::_assign_register_value;
+		case 0x7000:	return operation == &Chip8::_add_register_value;
+		case 0xA000:	return operation == &Chip8::_set_address_register;
+		case 0xF000:	return operation == &Chip8::_add_address_register;
 	}
 
-	// Get the operation from the operation map, and execute
-	// If the operation isn't in the map, inform that this is an invalid opcode
-	if(operation_map.find(opnum) != operation_map.end())
+	switch(opcode & 0x000F)
 	{
-		operation = operation_map[opnum];
-		(this->*operation) (address, register_x, register_y, value);
+		case 0x0000:	return operation == &Chip8::_assign_register_register;
+		case 0x0001:	return operation == &Chip8::_or;
+		case 0x0002:	return operation == &Chip8::_and;
+		case 0x0003:	return operation == &Chip8::_xor;
+		case 0x0004:	return operation == &Chip8::_add_register_register;
+		case 0x0005:	return operation == &Chip8::_subtract_register_register;
+		case 0x0006:	return operation == &Chip8::_shift_right && !Variant::SHIFT_VY;
+		case 0x0007:	return operation == &Chip8::_subtract_negative_register_register;
+		case 0x000E:	return operation == &Chip8::_shift_left && !Variant::SHIFT_VY;
 	}
-	else		// Operation wasn't found, need to throw invalid opcode
+
+	return false;
+}
+
+
+/*************
+* recompile_block()
+*
+* Compile the run of recompilable instructions starting at the given slot of
+* the instruction cache.  If the first instruction can't be compiled, the
+* slot is marked so that it isn't tried again until memory there changes.
+************/
+template<class Variant>
+void Chip8::recompile_block(unsigned short slot)
+{
+	RecompiledBlock* block = &recompiled_blocks[slot];
+	unsigned short opcodes[MAX_BLOCK_LENGTH];
+	unsigned int count = 0;
+
+	for(unsigned short i=slot; count<MAX_BLOCK_LENGTH && i<INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START; i+=2)
 	{
-		_invalid_opcode(opcode);
+		DecodedInstruction* instruction = &instruction_cache[i];
+
+		if(!instruction->decoded)
+		{
+			decode_instruction(i + INSTRUCTION_CACHE_START, instruction);
+		}
+
+		if(!is_recompilable<Variant>(instruction))
+		{
+			break;
+		}
+
+		opcodes[count] = instruction->opcode;
+		count++;
+	}
+
+	if(count == 0)
+	{
+		block->uncompilable = true;
+		return;
+	}
+
+	CompiledBlock function = NULL;
+	unsigned int length = recompiler->compile(opcodes, count, &function);
+
+	// The code buffer is full.  Throw away all compiled code and start over
+	if(length == 0)
+	{
+		clear_recompiled_blocks();
+		recompiler->reset();
+		length = recompiler->compile(opcodes, count, &function);
+	}
+
+	if(length == 0)
+	{
+		block->uncompilable = true;
+		return;
 	}
 
+	block->function = function;
+	block->length = length;
+	block->written_registers = 0;
+
+	for(unsigned int i=0; i<length; i++)
+	{
+		block->written_registers |= Recompiler::get_written_registers(opcodes[i]);
+	}
+}
+
+
+void Chip8::clear_recompiled_blocks()
+{
+	if(!recompiled_blocks)
+	{
+		return;
+	}
+
+	for(int i=0; i<INSTRUCTION_CACHE_END - INSTRUCTION_CACHE_START; i++)
+	{
+		recompiled_blocks[i].function = NULL;
+		recompiled_blocks[i].executions = 0;
+		recompiled_blocks[i].uncompilable = false;
+	}
+}
+
+
+/*************
+* run_recompiled_block()
+*
+* Run the compiled code for a block, and move the program counter past it.
+************/
+void Chip8::run_recompiled_block(RecompiledBlock* block)
+{
+	block->function(registers, &address_register);
+	program_counter += 2*block->length;
+
+}
+
+
+/*************
+* verify_recompiled_block()
+*
+* Lockstep test of a compiled block.  The compiled code is run on a copy of
+* the registers, then the block is interpreted as normal, and the two results
+* compared.  Compiled code only touches the registers and address register,
+* so memory and the display are always left as the interpreter leaves them.
+* Mismatches are reported, and the block is no longer compiled.
+************/
+void Chip8::verify_recompiled_block(RecompiledBlock* block)
+{
+	unsigned char compiled_registers[0x10];
+	unsigned short compiled_address = address_register;
+	unsigned short start_address = program_counter;
+
+	memcpy(compiled_registers, registers, 0x10);
+	block->function(compiled_registers, &compiled_address);
+
+	for(unsigned int i=0; i<block->length; i++)
+	{
+		cycle();
+	}
+
+	bool mismatch = program_counter != start_address + 2*block->length;
+	mismatch = mismatch || compiled_address != address_register;
+	mismatch = mismatch || memcmp(compiled_registers, registers, 0x10) != 0;
+
+	if(mismatch)
+	{
+		std::cout << "RECOMPILER MISMATCH: Block at 0x" << std::hex << start_address << std::endl;
+
+		for(int i=0; i<0x10; i++)
+		{
+			if(compiled_registers[i] != registers[i])
+			{
+				std::cout << "  V" << i << ": compiled 0x" << (unsigned short) compiled_registers[i];
+				std::cout << ", interpreted 0x" << (unsigned short) registers[i] << std::endl;
+			}
+		}
+		if(compiled_address != address_register)
+		{
+			std::cout << "  I: compiled 0x" << compiled_address << ", interpreted 0x" << address_register << std::endl;
+		}
+
+		block->function = NULL;
+		block->uncompilable = true;
+	}
+}
+
+
+/*************
+* execute_recompiled()
+*
+* Execute instructions, counting how often each address in the instruction
+* cache starts a step.  Once an address becomes hot, the run of
+* instructions starting there is compiled to native code, which is used
+* from then on whenever it fits in the remaining number of instructions.
+************/
+template<class Variant>
+unsigned int Chip8::execute_recompiled(unsigned int num_instructions)
+{
+	unsigned int executed = 0;
+
+	while(executed < num_instructions)
+	{
+		if(program_counter < INSTRUCTION_CACHE_START || program_counter >= INSTRUCTION_CACHE_END)
+		{
+			step<Variant, NoProfiling>();
+			executed++;
+			continue;
+		}
+
+		RecompiledBlock* block = &recompiled_blocks[program_counter - INSTRUCTION_CACHE_START];
+
+		if(!block->function && !block->uncompilable)
+		{
+			block->executions++;
+
+			if(block->executions >= RECOMPILE_THRESHOLD)
+			{
+				recompile_block<Variant>(program_counter - INSTRUCTION_CACHE_START);
+			}
+		}
+
+		if(block->function && block->length <= num_instructions - executed)
+		{
+			executed += block->length;
+
+			if(verify_recompiler)
+			{
+				verify_recompiled_block(block);
+			}
+			else
+			{
+				run_recompiled_block(block);
+			}
+			continue;
+		}
+
+		step<Variant, NoProfiling>();
+		executed++;
+	}
+
+	return executed;
 }
 
 
@@ -307,11 +1366,6 @@ void Chip8::_return(unsigned short address, unsigned char register_x, unsigned c
 	// Set the program counter to the address on the top of the stack
 	stack_pointer--;
 	program_counter = call_stack[stack_pointer];
-
-	// Update the stack as seen by any listeners
-	gui->update_stack(call_stack, stack_pointer, CALL_STACK_SIZE);
-	gui->update_stack_pointer(stack_pointer);
-	gui->update_program_counter(program_counter);
 }
 
 
@@ -341,8 +1395,6 @@ void Chip8::_system_call(unsigned short address, unsigned char register_x, unsig
 void Chip8::_jump(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	program_counter = address;
-
-	gui->update_program_counter(program_counter);
 }
 
 
@@ -358,7 +1410,7 @@ void Chip8::_jump(unsigned short address, unsigned char register_x, unsigned cha
 void Chip8::_call(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	// Is the stack full?
-	if(stack_pointer == CALL_STACK_SIZE)
+	if(stack_pointer >= call_stack_size)
 	{
 		std::cout << "ERROR:  Stack full in CALL" << std::endl;
 		return;
@@ -368,11 +1420,6 @@ void Chip8::_call(unsigned short address, unsigned char register_x, unsigned cha
 	stack_pointer++;
 
 	program_counter = address;
-
-	// Update the stack as seen by any listeners
-	gui->update_stack(call_stack, stack_pointer, CALL_STACK_SIZE);
-	gui->update_stack_pointer(stack_pointer);
-	gui->update_program_counter(program_counter);
 }
 
 
@@ -391,8 +1438,6 @@ void Chip8::_skip_equal_register_value(unsigned short address, unsigned char reg
 	if(registers[register_x] == value)
 	{
 		program_counter += 2;
-
-		gui->update_program_counter(program_counter);
 	}
 }
 
@@ -412,8 +1457,6 @@ void Chip8::_skip_not_equal_register_value(unsigned short address, unsigned char
 	if(registers[register_x] != value)
 	{
 		program_counter += 2;
-
-		gui->update_program_counter(program_counter);
 	}
 }
 
@@ -432,8 +1475,6 @@ void Chip8::_skip_equal_register_register(unsigned short address, unsigned char
 	if(registers[register_x] == registers[register_y])
 	{
 		program_counter += 2;
-
-		gui->update_program_counter(program_counter);
 	}
 }
 
@@ -452,8 +1493,6 @@ void Chip8::_skip_not_equal_register_register(unsigned short address, unsigned c
 	if(registers[register_x] != registers[register_y])
 	{
 		program_counter += 2;
-
-		gui->update_program_counter(program_counter);
 	}
 
 }
@@ -471,8 +1510,6 @@ void Chip8::_skip_not_equal_register_register(unsigned short address, unsigned c
 void Chip8::_assign_register_value(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = value;
-
-	gui->update_register(register_x, registers[register_x]);
 }
 
 
@@ -488,8 +1525,6 @@ void Chip8::_assign_register_value(unsigned short address, unsigned char registe
 void Chip8::_add_register_value(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] += value;
-
-	gui->update_register(register_x, registers[register_x]);	
 }
 
 
@@ -505,8 +1540,6 @@ void Chip8::_add_register_value(unsigned short address, unsigned char register_x
 void Chip8::_assign_register_register(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = registers[register_y];
-
-	gui->update_register(register_x, registers[register_x]);	
 }
 
 
@@ -522,8 +1555,6 @@ void Chip8::_assign_register_register(unsigned short address, unsigned char regi
 void Chip8::_or(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = registers[register_x] | registers[register_y];
-
-	gui->update_register(register_x, registers[register_x]);	
 }
 
 
@@ -539,8 +1570,6 @@ void Chip8::_or(unsigned short address, unsigned char register_x, unsigned char
 void Chip8::_and(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = registers[register_x] & registers[register_y];
-
-	gui->update_register(register_x, registers[register_x]);
 }
 
 
@@ -556,8 +1585,6 @@ void Chip8::_and(unsigned short address, unsigned char register_x, unsigned char
 void Chip8::_xor(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = registers[register_x] ^ registers[register_y];
-
-	gui->update_register(register_x, registers[register_x]);
 }
 
 
@@ -586,9 +1613,6 @@ void Chip8::_add_register_register(unsigned short address, unsigned char registe
 
 	// Assign the target register
 	registers[register_x] = (unsigned char) (total & 0x00FF);
-
-	gui->update_register(register_x, registers[register_x]);
-	gui->update_register(0x0F, registers[0x0F]);	
 }
 
 
@@ -618,9 +1642,6 @@ void Chip8::_subtract_register_register(unsigned short address, unsigned char re
 	difference -= registers[register_y];
 
 	registers[register_x] = (unsigned char) difference;
-
-	gui->update_register(register_x, registers[register_x]);
-	gui->update_register(0x0F, registers[0x0F]);		
 }
 
 
@@ -650,9 +1671,6 @@ void Chip8::_subtract_negative_register_register(unsigned short address, unsigne
 	difference -= registers[register_x];
 
 	registers[register_x] = (unsigned char) difference;	
-
-	gui->update_register(register_x, registers[register_x]);
-	gui->update_register(0x0F, registers[0x0F]);		
 }
 
 
@@ -680,9 +1698,6 @@ void Chip8::_shift_right(unsigned short address, unsigned char register_x, unsig
 
 	// Right shift - make sure that the shifted in bit is 0
 	registers[register_x] = (registers[register_x] >> 1) & 0x7F;
-
-	gui->update_register(register_x, registers[register_x]);
-	gui->update_register(0x0F, registers[0x0F]);		
 }
 
 
@@ -709,9 +1724,6 @@ void Chip8::_shift_left(unsigned short address, unsigned char register_x, unsign
 
 	// Right shift - make sure that the shifted in bit is 0
 	registers[register_x] = (registers[register_x] << 1) & 0xFE;
-
-	gui->update_register(register_x, registers[register_x]);
-	gui->update_register(0x0F, registers[0x0F]);		
 }
 
 
@@ -726,8 +1738,6 @@ void Chip8::_shift_left(unsigned short address, unsigned char register_x, unsign
 void Chip8::_set_address_register(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	address_register = address;
-
-	gui->update_address_register(address_register);
 }
 
 
@@ -745,8 +1755,6 @@ void Chip8::_jump_offset(unsigned short address, unsigned char register_x, unsig
 	// NOTE:  What if the program counter exceeds an allowable value?
 
 	program_counter = address + registers[0x00];
-
-	gui->update_program_counter(program_counter);
 }
 
 
@@ -762,25 +1770,25 @@ void Chip8::_jump_offset(unsigned short address, unsigned char register_x, unsig
 *********************/
 void Chip8::_random(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
-	registers[register_x] = (rand() % 0x100) & value;
-
-	gui->update_register(register_x, registers[register_x]);
+	registers[register_x] = (next_random() >> 24) & value;
 }
 
 
 /*********************
-* _draw
+* draw_sprite
 *
 * Draw a sprite at the location (Vx, Vy).  The sprite is 8 pixels wide and
 * N pixels high, where N is the value passed in.  The sprite is stored in the 
-* current address register.
+* current address register.  A clipped sprite which starts off the screen
+* wraps onto it, and is then cut off at the right side and bottom.
 *
 * Parameters
 *   unsigned char register_x - the register containing the x coordinate of the sprite
 *   unsigned char reigster_y - the register containing the y coordinate of the sprite
 *	unsigned char value - the number of pixels in height of the sprite.
 *********************/
-void Chip8::_draw(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+template<bool clip_sprites>
+void Chip8::draw_sprite(unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 
 	bool collision = false;
@@ -788,6 +1796,12 @@ void Chip8::_draw(unsigned short address, unsigned char register_x, unsigned cha
 	unsigned char x = registers[register_x];
 	unsigned char y = registers[register_y];
 
+	if(clip_sprites)
+	{
+		x = x % display->get_width();
+		y = y % display->get_height();
+	}
+
 	// Only use the last 4 bits of the value as the number of lines to draw
 	unsigned char n_lines = value & 0x0F;
 
@@ -798,7 +1812,14 @@ void Chip8::_draw(unsigned short address, unsigned char register_x, unsigned cha
 
 		// NOTE:   Perform write_line first, otherwise short circuit could prevent
 		//         call to write_line
-		collision = display->write_line(x, y+i, line) || collision;
+		if(clip_sprites)
+		{
+			collision = display->write_clipped_line(x, y+i, line) || collision;
+		}
+		else
+		{
+			collision = display->write_line(x, y+i, line) || collision;
+		}
 	}
 	if(collision)
 	{
@@ -808,9 +1829,17 @@ void Chip8::_draw(unsigned short address, unsigned char register_x, unsigned cha
 	{
 		registers[0x0F] = 0x00;
 	}
+}
 
-	gui->refresh_display();
-	gui->update_register(0x0F, registers[0x0F]);		
+
+/*********************
+* _draw
+*
+* Draw a sprite, wrapping around the edges of the screen
+*********************/
+void Chip8::_draw(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	draw_sprite<false>(register_x, register_y, value);
 }
 
 
@@ -821,7 +1850,6 @@ void Chip8::_skip_key_pressed(unsigned short address, unsigned char register_x,
 	if(keyboard->is_key_pressed(key))
 	{
 		program_counter += 2;
-		gui->update_program_counter(program_counter);
 	}
 
 }
@@ -835,7 +1863,6 @@ void Chip8::_skip_key_not_pressed(unsigned short address, unsigned char register
 	if(!keyboard->is_key_pressed(key))
 	{
 		program_counter += 2;
-		gui->update_program_counter(program_counter);
 	}
 }
 
@@ -852,8 +1879,8 @@ void Chip8::_get_key(unsigned short address, unsigned char register_x, unsigned
 		{
 			registers[register_x] = i;
 			got_key_press = true;
-			// Unset the key?
-			keyboard->release_key(i);
+			// Unset the key, so it isn't read again in this frame
+			keyboard->consume_key(i);
 			break;
 		}
 	}
@@ -863,9 +1890,6 @@ void Chip8::_get_key(unsigned short address, unsigned char register_x, unsigned
 	{
 		program_counter -= 2;
 	}
-	
-	gui->update_program_counter(program_counter);
-	gui->update_register(register_x, registers[register_x]);
 }
 
 
@@ -880,8 +1904,6 @@ void Chip8::_get_key(unsigned short address, unsigned char register_x, unsigned
 void Chip8::_get_delay_timer(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	registers[register_x] = delay_timer;
-
-	gui->update_register(register_x, registers[register_x]);
 }
 
 
@@ -896,8 +1918,6 @@ void Chip8::_get_delay_timer(unsigned short address, unsigned char register_x, u
 void Chip8::_set_delay_timer(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	delay_timer = registers[register_x];
-
-	gui->update_delay_timer(delay_timer);
 }
 
 
@@ -912,8 +1932,6 @@ void Chip8::_set_delay_timer(unsigned short address, unsigned char register_x, u
 void Chip8::_set_sound_timer(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	sound_timer = registers[register_x];
-
-	gui->update_sound_timer(sound_timer);
 }
 
 
@@ -929,8 +1947,6 @@ void Chip8::_add_address_register(unsigned short address, unsigned char register
 {
 	address_register += registers[register_x];
 
-	gui->update_address_register(address_register);
-
 	if(address_register > 0x0FFF)
 	{
 		registers[0x0F] = 0x01;
@@ -942,8 +1958,6 @@ void Chip8::_add_address_register(unsigned short address, unsigned char register
 void Chip8::_set_address_sprite(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
 	address_register = memory->get_sprite_address(registers[register_x]);
-
-	gui->update_address_register(address_register);
 }
 
 
@@ -962,11 +1976,8 @@ void Chip8::_store_bcd(unsigned short address, unsigned char register_x, unsigne
 	unsigned char value_1s = bcd_value;
 
 	// Store the three bytes
-	memory->dump(address_register, value_100s);
-	memory->dump(address_register+1, value_10s);
-	memory->dump(address_register+2, value_1s);
-
-	gui->update_memory();
+	unsigned char digits[3] = {value_100s, value_10s, value_1s};
+	memory->write(address_register, digits, 3);
 }
 
 
@@ -981,15 +1992,9 @@ void Chip8::_store_bcd(unsigned short address, unsigned char register_x, unsigne
 *********************/
 void Chip8::_dump_register(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
 {
-	// Loop through the registers and write to memory
-	for(int reg_num=0; reg_num <= register_x; reg_num++)
-	{
-		memory->dump(address_register, registers[reg_num]);
-		address_register++;
-	}
-
-	gui->update_memory();
-	gui->update_address_register(address_register);
+	// Write the registers to memory in one go
+	memory->write(address_register, registers, register_x + 1);
+	address_register += register_x + 1;
 }
 
 
@@ -1009,12 +2014,170 @@ void Chip8::_load_register(unsigned short address, unsigned char register_x, uns
 	{
 		registers[reg_num] = memory->fetch(address_register);
 		address_register++;
+	}
+}
+
+
+/**********************
+* SCHIP OPCODES
+*
+* Only reachable by the interpreter for the SCHIP instruction set.
+**********************/
+
+void Chip8::_scroll_down(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	unsigned char num_rows = value & 0x0F;
+	display->scroll_down(num_rows);
+}
+
+void Chip8::_scroll_right(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	display->scroll_right(4);
+}
+
+void Chip8::_scroll_left(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	display->scroll_left(4);
+}
+
+void Chip8::_exit(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	// Halt by repeating this instruction, rather than blocking the thread
+	// running the chip, so that the chip can still be paused, reset or
+	// stopped by whoever is driving it
+	if(!halted)
+	{
+		std::cout << "EXIT" << std::endl;
+	}
+	halted = true;
+
+	program_counter -= 2;
+}
+
+void Chip8::_enable_extended_screen(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	std::cout << "Extended screen mode" << std::endl;
+	display->resize(128,64);
+	graphicMode = HIRES;
+}
+
+void Chip8::_disable_extended_screen(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	std::cout << "Normal screen mode" << std::endl;
+	display->resize(64,32);
+	graphicMode = LORES;
+}
+
+
+/*********************
+* draw_extended_sprite
+*
+* Draw a sprite as SCHIP does.  If the number of lines is 0, draw a 16x16
+* sprite (16 lines of 8 pixels in low resolution), otherwise draw as Chip-8.
+*********************/
+template<bool clip_sprites>
+void Chip8::draw_extended_sprite(unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	bool collision = false;
+	unsigned char num_lines = value & 0x0F;
+
+	// If the number of rows given is 0, then draw a 16x16 sprite.  Otherwise, draw an Nx8 sprite
+	if(num_lines == 0) 		// Need to draw 16 lines of 16 pixels
+	{
+
+		unsigned char x = registers[register_x];
+		unsigned char y = registers[register_y];
+
+		if(clip_sprites)
+		{
+			x = x % display->get_width();
+			y = y % display->get_height();
+		}
+
+		// Is the display 128x64, or 64x32??
+		if(graphicMode == HIRES)
+		{
+			for(int i=0; i<32; i=i+2)
+			{
+				unsigned short line = (memory->fetch(address_register + i) << 8) | memory->fetch(address_register + i + 1);
+				if(clip_sprites)
+				{
+					collision = display->write_clipped_wide_line(x, y + (i/2),  line) || collision;
+				}
+				else
+				{
+					collision = display->write_wide_line(x, y + (i/2),  line) || collision;
+				}
+			}
+		}
+		else
+		{
+			for(int i=0; i<16; i++)
+			{
+				unsigned char line = memory->fetch(address_register + i);
+				if(clip_sprites)
+				{
+					collision = display->write_clipped_line(x, y + i,  line) || collision;
+				}
+				else
+				{
+					collision = display->write_line(x, y + i,  line) || collision;
+				}
+			}			
+		}
+		
+	}
+	else 				// Draw using Chip-8 method
+	{
+		draw_sprite<clip_sprites>(register_x, register_y, value);
+	}
+
+	if(collision)
+	{
+		registers[0x0F] = 0x01;
+	}
+	else
+	{
+		registers[0x0F] = 0x00;
+	}
+}
+
+
+/*********************
+* _draw_extended
+*
+* Draw a SCHIP sprite, wrapping around the edges of the screen
+*********************/
+void Chip8::_draw_extended(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	draw_extended_sprite<false>(register_x, register_y, value);
+}
 
-		gui->update_register(reg_num, registers[reg_num]);
+
+void Chip8::_set_address_big_sprite(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	address_register = memory->get_big_sprite_address(registers[register_x]);
+}
+
+void Chip8::_dump_register_rpl(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	// NOTE: Not sure what to do here.  May need to incorporate another hardware abstraction
+	for(int i=0; i<=register_x; i++)
+	{
+		hp_registers[i] = registers[i];
+	}
+}
+
+void Chip8::_load_register_rpl(unsigned short address, unsigned char register_x, unsigned char register_y, unsigned char value)
+{
+	// NOTE: Not sure what to do here.  May need to incorporate another hardware abstraction
+	for(int i=0; i<=register_x; i++)
+	{
+		registers[i] = hp_registers[i];
 	}
-	gui->update_address_register(address_register);
 }
 
+
 void Chip8::_invalid_opcode(unsigned short opcode)
 {
 	std::cout << "INVALID OPCODE: 0x" << std::hex << opcode << std::endl;
@@ -1040,3 +2203,276 @@ unsigned char Chip8::get_stack_pointer()
 	return stack_pointer;
 }
 
+bool Chip8::is_halted()
+{
+	return halted;
+}
+
+
+/*************
+* set_seed(unsigned int seed)
+*
+* Seed the random number generator used by the random instruction (CXNN)
+************/
+void Chip8::set_seed(unsigned int _seed)
+{
+	seed = _seed;
+
+	random_state = 0;
+	next_random();
+	random_state += seed;
+	next_random();
+}
+
+
+/*************
+* next_random()
+*
+* Advance the random number generator, and return 32 random bits.  This is
+* PCG32 (XSH RR):  a 64-bit linear congruential generator, whose output is a
+* permutation of the top bits of its state.
+************/
+unsigned int Chip8::next_random()
+{
+	uint64_t old_state = random_state;
+	random_state = old_state * RANDOM_MULTIPLIER + RANDOM_INCREMENT;
+
+	uint32_t xorshifted = ((old_state >> 18) ^ old_state) >> 27;
+	uint32_t rotation = old_state >> 59;
+
+	return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+}
+
+
+unsigned int Chip8::get_seed()
+{
+	return seed;
+}
+
+
+/*************
+* save(Snapshot* snapshot)
+*
+* Write the registers, call stack, timers, program counter and the state of
+* the random number generator to the snapshot
+************/
+void Chip8::save(Snapshot* snapshot)
+{
+	snapshot->begin_section(CHIP8_SECTION);
+
+	snapshot->write_bytes(registers, 0x10);
+	snapshot->write_short(address_register);
+
+	snapshot->write_byte(call_stack_size);
+	snapshot->write_byte(stack_pointer);
+	for(int i=0; i<call_stack_size; i++)
+	{
+		snapshot->write_short(call_stack[i]);
+	}
+
+	snapshot->write_short(delay_timer);
+	snapshot->write_short(sound_timer);
+
+	snapshot->write_short(program_counter);
+	snapshot->write_byte(halted ? 1 : 0);
+
+	snapshot->write_word(random_state);
+
+	snapshot->end_section();
+}
+
+
+/*************
+* restore(Snapshot* snapshot)
+*
+* Replace the state of the chip with the one in the snapshot, and update the
+* listener.  Returns false if the snapshot doesn't hold a valid chip.
+************/
+bool Chip8::restore(Snapshot* snapshot)
+{
+	if(!snapshot->open_section(CHIP8_SECTION))
+	{
+		return false;
+	}
+
+	// Read everything before changing the chip, so an invalid snapshot leaves
+	// it as it was
+	unsigned char _registers[0x10];
+	snapshot->read_bytes(_registers, 0x10);
+	unsigned short _address_register = snapshot->read_short();
+
+	// The call stack is only restored into a chip with a stack of the same size
+	if(snapshot->read_byte() != call_stack_size)
+	{
+		return false;
+	}
+
+	unsigned char _stack_pointer = snapshot->read_byte();
+	unsigned short _call_stack[0x100];
+	for(int i=0; i<call_stack_size; i++)
+	{
+		_call_stack[i] = snapshot->read_short();
+	}
+
+	unsigned short _delay_timer = snapshot->read_short();
+	unsigned short _sound_timer = snapshot->read_short();
+
+	unsigned short _program_counter = snapshot->read_short();
+	bool _halted = snapshot->read_byte() != 0;
+
+	uint64_t _random_state = snapshot->read_word();
+
+	if(!snapshot->close_section() || _stack_pointer > call_stack_size)
+	{
+		return false;
+	}
+
+	memcpy(registers, _registers, 0x10);
+	address_register = _address_register;
+
+	stack_pointer = _stack_pointer;
+	memcpy(call_stack, _call_stack, call_stack_size * sizeof(unsigned short));
+
+	delay_timer = _delay_timer;
+	sound_timer = _sound_timer;
+
+	program_counter = _program_counter;
+	halted = _halted;
+
+	random_state = _random_state;
+
+	refresh_listener();
+
+	return true;
+}
+
+
+/*************
+* refresh_listener()
+*
+* Inform the listener of the entire state of the chip
+************/
+void Chip8::refresh_listener()
+{
+	inform_listener(true);
+}
+
+
+/*************
+* update_listener()
+*
+* Inform the listener of everything which has changed since it was last
+* informed, in a single call.  Called once a frame by the clock, so the
+* listener isn't called for every instruction.
+************/
+void Chip8::update_listener()
+{
+	inform_listener(false);
+}
+
+
+/*************
+* inform_listener(bool everything)
+*
+* Compare the state of the chip with what the listener was last told, and
+* pass on the differences, or everything if asked
+************/
+void Chip8::inform_listener(bool everything)
+{
+	if(!gui)
+	{
+		return;
+	}
+
+	changes.changed_registers = 0;
+	for(int i=0; i<0x10; i++)
+	{
+		if(everything || registers[i] != changes.registers[i])
+		{
+			changes.changed_registers |= 1 << i;
+			changes.registers[i] = registers[i];
+		}
+	}
+
+	changes.address_register_changed = everything || address_register != changes.address_register;
+	changes.address_register = address_register;
+
+	changes.program_counter_changed = everything || program_counter != changes.program_counter;
+	changes.program_counter = program_counter;
+
+	changes.stack_changed = everything || stack_pointer != changes.stack_pointer ||
+	                        memcmp(call_stack, listener_stack, call_stack_size * sizeof(unsigned short)) != 0;
+	changes.stack = call_stack;
+	changes.stack_pointer = stack_pointer;
+	changes.stack_size = call_stack_size;
+	memcpy(listener_stack, call_stack, call_stack_size * sizeof(unsigned short));
+
+	changes.delay_timer_changed = everything || delay_timer != changes.delay_timer;
+	changes.delay_timer = delay_timer;
+
+	changes.sound_timer_changed = everything || sound_timer != changes.sound_timer;
+	changes.sound_timer = sound_timer;
+
+	changes.display_changed = everything || display->get_generation() != listener_display_generation;
+	listener_display_generation = display->get_generation();
+
+	if(everything)
+	{
+		changes.memory_changed = true;
+		changes.memory_start = 0;
+		changes.memory_end = MEMORY_SIZE;
+	}
+
+	gui->update_changes(&changes);
+
+	changes.memory_changed = false;
+}
+
+
+/*************
+* fork(Memory* memory, Display* display, Keyboard* keyboard)
+*
+* Create a copy of the chip, with the same registers, stack and timers, which
+* runs on the given components (normally forks of this chip's components).
+* The copy has no listener, and starts with empty caches, which it builds as
+* it runs, so forking doesn't copy them.
+************/
+Chip8* Chip8::fork(Memory* _memory, Display* _display, Keyboard* _keyboard)
+{
+	Chip8* child = new Chip8(*this);
+	child->fork_components(_memory, _display, _keyboard);
+
+	return child;
+}
+
+
+/*************
+* fork_components(Memory* memory, Display* display, Keyboard* keyboard)
+*
+* Fix up a copy of a chip, so it doesn't share anything it owns with the
+* chip it was copied from
+************/
+void Chip8::fork_components(Memory* _memory, Display* _display, Keyboard* _keyboard)
+{
+	memory = _memory;
+	display = _display;
+	keyboard = _keyboard;
+
+	unsigned short* parent_stack = call_stack;
+	call_stack = new unsigned short[call_stack_size];
+	memcpy(call_stack, parent_stack, call_stack_size * sizeof(unsigned short));
+
+	listener_stack = new unsigned short[call_stack_size];
+	memset(listener_stack, 0, call_stack_size * sizeof(unsigned short));
+
+	gui = NULL;
+	profiler = NULL;
+
+	// The caches are rebuilt by the copy as it runs, rather than copied
+	instruction_cache = NULL;
+	block_lengths = NULL;
+	recompiler = NULL;
+	recompiled_blocks = NULL;
+
+	memory->add_listener(this);
+}
@@ -0,0 +1,34 @@
+#include "core/chip_variant.h"
+
+static const char* QUIRK_PROFILE_NAMES[NUM_QUIRK_PROFILES] = {"default", "cosmac", "schip"};
+
+
+const char* get_quirk_profile_name(QuirkProfile profile)
+{
+	if(profile >= NUM_QUIRK_PROFILES)
+	{
+		return "unknown";
+	}
+
+	return QUIRK_PROFILE_NAMES[profile];
+}
+
+
+/************
+* find_quirk_profile(const std::string& name, QuirkProfile* profile)
+*
+* Look up a quirk profile by name.  Returns false if there is no such profile.
+************/
+bool find_quirk_profile(const std::string& name, QuirkProfile* profile)
+{
+	for(int i=0; i<NUM_QUIRK_PROFILES; i++)
+	{
+		if(name == QUIRK_PROFILE_NAMES[i])
+		{
+			*profile = (QuirkProfile) i;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -1,76 +1,140 @@
 #include "core/clock.h"
 #include "core/chip8.h"
+#include "core/rewind.h"
+#include "core/frame_buffer.h"
 
 #include <thread>
 #include <iostream>
 
 Clock::Clock(Chip8* _chip)
 {
-	clock_period = 2000;
-	delay_period = 16667;
-	sound_period = 16667;
+	instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+
+	pacing = REAL_TIME;
+	speed = 1.0;
+
+	frame_count = 0;
 
 	running = false;
 	exists = true;
+	rewinding = false;
 
 	chip = _chip;
+	rewind = NULL;
+	frame_buffer = NULL;
+	listener = NULL;
 }
 
 Clock::~Clock()
 {
 	exists = false;
 
-	clock_thread.join();
-	delay_thread.join();
-	sound_thread.join();
+	if(clock_thread.joinable())
+	{
+		clock_thread.join();
+	}
 }
 
 void Clock::start()
 {
-	clock_thread = std::thread(&Clock::runChipClock, this);
-	delay_thread = std::thread(&Clock::runDelayClock, this);
-	sound_thread = std::thread(&Clock::runSoundClock, this);
+	clock_thread = std::thread(&Clock::runClock, this);
 }
 
-void Clock::runChipClock()
-{
-	std::cout << "Starting Chip Clock" << std::endl;
 
-	while(exists)
+/*************
+* run_frame()
+*
+* Run a frame's worth of instructions, then tick the timers, inform the
+* chip's listener of the changes, publish the display to the frame buffer,
+* and record the frame in the rewind history.  When rewinding, step back a
+* frame instead.  Returns the number of instructions executed.
+************/
+unsigned int Clock::run_frame()
+{
+	if(rewinding && rewind)
 	{
-		usleep(clock_period);
-		if(running)
+		if(rewind->step_back() && listener)
+		{
+			listener->frame_rewound();
+		}
+		if(frame_buffer)
 		{
-			chip->cycle();
+			frame_buffer->publish();
 		}
+		return 0;
 	}
-}
 
-void Clock::runDelayClock()
-{
-	std::cout << "Starting Delay Clock" << std::endl;
+	if(listener)
+	{
+		listener->frame_starting();
+	}
 
-	while(exists)
+	unsigned int executed = chip->execute(instructions_per_frame);
+
+	chip->cycle_delay();
+	chip->cycle_sound();
+	chip->update_listener();
+
+	if(frame_buffer)
 	{
-		usleep(delay_period);
-		if(running)
-		{
-			chip->cycle_delay();
-		}
+		frame_buffer->publish();
+	}
+
+	frame_count++;
+
+	if(rewind)
+	{
+		rewind->record();
 	}
+
+	return executed;
 }
 
-void Clock::runSoundClock()
+
+/*************
+* runClock()
+*
+* Run frames while the clock is running, until the clock is destroyed.  When
+* pacing to real time, each frame is scheduled a fixed period after the last,
+* rather than after the last frame finished, so the frame rate doesn't drift.
+************/
+void Clock::runClock()
 {
-	std::cout << "Starting Sound Clock" << std::endl;
+	std::cout << "Starting Chip Clock" << std::endl;
+
+	std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
 
 	while(exists)
 	{
-		usleep(sound_period);
-		if(running)
+		std::chrono::duration<double> frame_period(1.0 / (FRAMES_PER_SECOND * speed));
+
+		if(!running)
+		{
+			std::this_thread::sleep_for(frame_period);
+			next_frame = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		run_frame();
+
+		if(pacing == UNTHROTTLED)
+		{
+			next_frame = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_period);
+
+		// If the chip has fallen too far behind (e.g., the process was
+		// suspended), start again from now, rather than running a burst of
+		// frames to catch up
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(now - next_frame > MAX_FRAMES_BEHIND * frame_period)
 		{
-			chip->cycle_sound();
+			next_frame = now;
 		}
+
+		std::this_thread::sleep_until(next_frame);
 	}
 }
 
@@ -82,4 +146,126 @@ void Clock::run()
 void Clock::pause()
 {
 	running = false;
-}
\ No newline at end of file
+}
+
+bool Clock::is_running()
+{
+	return running;
+}
+
+
+void Clock::set_instructions_per_frame(unsigned int _instructions_per_frame)
+{
+	instructions_per_frame = _instructions_per_frame;
+}
+
+
+unsigned int Clock::get_instructions_per_frame()
+{
+	return instructions_per_frame;
+}
+
+
+/*************
+* set_pacing(ClockPacing pacing)
+*
+* Pace frames to real time (scaled by the speed), or run them as fast as
+* possible
+************/
+void Clock::set_pacing(ClockPacing _pacing)
+{
+	pacing = _pacing;
+}
+
+
+ClockPacing Clock::get_pacing()
+{
+	return pacing;
+}
+
+
+/*************
+* set_speed(double speed)
+*
+* Set the multiple of real time to run at, when pacing to real time, e.g.,
+* 2.0 runs 120 frames per second
+************/
+void Clock::set_speed(double _speed)
+{
+	if(_speed > 0.0)
+	{
+		speed = _speed;
+	}
+}
+
+
+double Clock::get_speed()
+{
+	return speed;
+}
+
+
+unsigned long Clock::get_frame_count()
+{
+	return frame_count;
+}
+
+
+/*************
+* add_listener(ClockListener* listener)
+*
+* The listener is informed from the thread running the frames.  Should be set
+* before the clock is started.
+************/
+void Clock::add_listener(ClockListener* _listener)
+{
+	listener = _listener;
+}
+
+
+/*************
+* set_rewind(Rewind* rewind)
+*
+* Record each frame in the rewind history, or stop recording if NULL.  Should
+* be set before the clock is started.
+************/
+void Clock::set_rewind(Rewind* _rewind)
+{
+	rewind = _rewind;
+}
+
+
+/*************
+* set_rewinding(bool rewinding)
+*
+* Step back through the rewind history each frame, rather than running
+************/
+void Clock::set_rewinding(bool _rewinding)
+{
+	rewinding = _rewinding;
+}
+
+
+bool Clock::is_rewinding()
+{
+	return rewinding;
+}
+
+
+/*************
+* set_frame_buffer(FrameBuffer* frame_buffer)
+*
+* Publish the display to the frame buffer after each frame, or stop if NULL.
+* The frame buffer must be of the chip's display.  Should be set before the
+* clock is started.
+************/
+void Clock::set_frame_buffer(FrameBuffer* _frame_buffer)
+{
+	frame_buffer = _frame_buffer;
+}
+
+
+FrameBuffer* Clock::get_frame_buffer()
+{
+	return frame_buffer;
+}
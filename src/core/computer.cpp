@@ -1,4 +1,5 @@
 #include "core/computer.h"
+#include "core/rom_image.h"
 
 #include <iostream>
 #include <fstream>
@@ -9,6 +10,13 @@ Computer::Computer()
 	memory = new Memory();
 	display = new Display();
 	keyboard = new Keyboard();
+	clock = NULL;
+
+	rom_database = NULL;
+	rom_catalog = NULL;
+	rollback = NULL;
+
+	owns_components = false;
 }
 
 
@@ -19,11 +27,26 @@ Computer::Computer(Chip8* _chip8, Clock* _clock, Memory* _memory, Display* _disp
 	display = _display;
 	keyboard = _keyboard;
 	clock = _clock;
+
+	rom_database = NULL;
+	rom_catalog = NULL;
+	rollback = NULL;
+
+	owns_components = false;
 }
 
 Computer::~Computer()
 {
+	if(owns_components)
+	{
+		delete clock;
+		delete chip;
+		delete display;
+		delete memory;
+		delete keyboard;
+	}
 
+	delete rollback;
 }
 
 void Computer::press_key(unsigned char key_num)
@@ -40,12 +63,14 @@ void Computer::release_key(unsigned char key_num)
 void Computer::cycle()
 {
 	chip->cycle();
+	chip->update_listener();
 }
 
 void Computer::cycle_timers()
 {
 	chip->cycle_delay();
 	chip->cycle_sound();
+	chip->update_listener();
 }
 
 bool Computer::get_pixel(unsigned char x, unsigned char y)
@@ -68,6 +93,31 @@ void Computer::resize_display(unsigned int width, unsigned int height)
 	display->resize(width, height);
 }
 
+unsigned int Computer::run_frame()
+{
+	return clock->run_frame();
+}
+
+Clock* Computer::get_clock()
+{
+	return clock;
+}
+
+Chip8* Computer::get_chip()
+{
+	return chip;
+}
+
+Keyboard* Computer::get_keyboard()
+{
+	return keyboard;
+}
+
+Memory* Computer::get_memory()
+{
+	return memory;
+}
+
 void Computer::run()
 {
 	clock->run();
@@ -80,51 +130,86 @@ void Computer::pause()
 
 
 /*************
-* load()
+* set_rom_database(RomDatabase* database)
+*
+* Look up each program loaded in the database, and switch the chip to the
+* program's quirk profile.  Programs not in the database keep the chip's
+* current quirks.
+************/
+void Computer::set_rom_database(RomDatabase* database)
+{
+	rom_database = database;
+}
+
+
+/*************
+* set_rom_catalog(RomCatalog* catalog)
+*
+* Load programs through the catalog, so each file is only read once, and run
+* them with the quirks and number of instructions per frame cataloged for
+* them.  The catalog takes the place of the ROM database.
+************/
+void Computer::set_rom_catalog(RomCatalog* catalog)
+{
+	rom_catalog = catalog;
+}
+
+
+/*************
+* load(const char* filename)
 *
-* Load a program into memory.
+* Load a program into memory, and select its quirks if it is in the ROM
+* database.  With a catalog, the program is taken from the catalog instead.
 ************/
 void Computer::load(const char* filename)
 {
-	// Open the file
-	std::ifstream romfile;
-	romfile.open(filename, std::ios::in | std::ios::binary);
+	if(rom_catalog)
+	{
+		const CatalogEntry* entry = rom_catalog->add(filename);
+		if(entry)
+		{
+			load(entry);
+		}
+		return;
+	}
 
-	// If the file didn't open, return
-	if(!romfile.is_open())
+	// Map the file, and copy it straight into memory
+	RomImage image;
+	if(!image.open(filename))
 	{
-		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
 		return;
 	}
 
-	// Load the entirity of the file into a char array, then write to memory
-	// NOTE:  Should the file just be passed to memory to load directly?
+	std::cout << "Start address of RAM: 0x" << std::hex << memory->get_ram_start() << std::endl;
+	image.load(memory);
+
+	QuirkProfile quirks;
+	if(rom_database && rom_database->find(image.get_data(), image.get_size(), &quirks))
+	{
+		std::cout << "Quirk profile: " << get_quirk_profile_name(quirks) << std::endl;
+		chip->set_quirks(quirks);
+	}
+}
 
-	// Figure out how long the file is
-	long begin, end;
-	begin = romfile.tellg();
-	romfile.seekg(0, std::ios::end);
-	end = romfile.tellg();
-	int size = (int) (end - begin);
 
-	// Load the file
-	char* memblock = new char[size];
+/*************
+* load(const CatalogEntry* entry)
+*
+* Load a cataloged program into memory, and set up the chip and clock as
+* cataloged for it.
+************/
+void Computer::load(const CatalogEntry* entry)
+{
+	RomImage::load(memory, entry->filename, entry->data.data(), entry->data.size());
 
-	romfile.seekg(0, std::ios::beg);
-	romfile.read(memblock, size);
-	romfile.close();
+	std::cout << "Program: " << RomCatalog::get_variant_name(entry->variant) << ", quirk profile: " << get_quirk_profile_name(entry->quirks);
+	std::cout << ", " << std::dec << entry->instructions_per_frame << " instructions per frame" << std::endl;
 
-	// Dump the loaded file into memory
-	unsigned short start_address = memory->get_ram_start();
-	std::cout << "Start address of RAM: 0x" << std::hex << start_address << std::endl;
-	for(int i=0; i<size; i++)
+	chip->set_quirks(entry->quirks);
+	if(clock)
 	{
-		memory->dump(start_address + i, memblock[i]);
+		clock->set_instructions_per_frame(entry->instructions_per_frame);
 	}
-
-	delete [] memblock;
-
-	memory->print_memory(start_address, size);
 }
 
 void Computer::soft_reset()
@@ -133,6 +218,96 @@ void Computer::soft_reset()
 	display->clear();
 }
 
+/************
+* save(Snapshot* snapshot)
+*
+* Save the complete state of the computer into the snapshot.  Returns false if
+* it didn't fit.
+************/
+bool Computer::save(Snapshot* snapshot)
+{
+	snapshot->begin();
+
+	// The chip goes last, so the listener is updated once everything else has
+	// been restored
+	memory->save(snapshot);
+	display->save(snapshot);
+	keyboard->save(snapshot);
+	chip->save(snapshot);
+
+	return snapshot->is_valid();
+}
+
+
+/************
+* restore(Snapshot* snapshot)
+*
+* Restore the complete state of the computer from the snapshot.  Returns false
+* if the snapshot isn't valid, or is of a different kind of computer, in which
+* case the computer is put back as it was.
+************/
+bool Computer::restore(Snapshot* snapshot)
+{
+	// Components are restored one at a time, so keep the current state, to
+	// undo the components already restored if a later one fails
+	if(!rollback)
+	{
+		rollback = new Snapshot();
+	}
+	save(rollback);
+
+	if(snapshot->open() &&
+	   memory->restore(snapshot) &&
+	   display->restore(snapshot) &&
+	   keyboard->restore(snapshot) &&
+	   chip->restore(snapshot))
+	{
+		return true;
+	}
+
+	rollback->open();
+	memory->restore(rollback);
+	display->restore(rollback);
+	keyboard->restore(rollback);
+	chip->restore(rollback);
+
+	return false;
+}
+
+/************
+* fork()
+*
+* Create a copy of the computer, e.g., to explore a different input from the
+* current state.  The memory and display of the copy share pages with this
+* computer until either of them writes to a page, so forking only costs the
+* pages later written to.  The copy has its own clock, with the same settings,
+* which isn't started or running, and no listeners.  The computer shouldn't be
+* running while it is forked.
+************/
+Computer* Computer::fork()
+{
+	Memory* child_memory = memory->fork();
+	Display* child_display = display->fork();
+	Keyboard* child_keyboard = new Keyboard(*keyboard);
+	Chip8* child_chip = chip->fork(child_memory, child_display, child_keyboard);
+
+	Clock* child_clock = new Clock(child_chip);
+	if(clock)
+	{
+		child_clock->set_instructions_per_frame(clock->get_instructions_per_frame());
+		child_clock->set_pacing(clock->get_pacing());
+		child_clock->set_speed(clock->get_speed());
+	}
+
+	Computer* child = new Computer(child_chip, child_clock, child_memory, child_display, child_keyboard);
+	child->owns_components = true;
+	child->rom_database = rom_database;
+	child->rom_catalog = rom_catalog;
+
+	return child;
+}
+
+
 std::string Computer::get_memory_string()
 {
 	return (memory->to_string(16));
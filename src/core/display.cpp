@@ -1,24 +1,57 @@
 #include "core/display.h"
+#include "core/snapshot.h"
 
 #include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocate a blank page, aligned to a cache line
+static DisplayPage* new_page()
+{
+	void* memory;
+	if(posix_memalign(&memory, DISPLAY_PAGE_ALIGNMENT, sizeof(DisplayPage)) != 0)
+	{
+		throw std::bad_alloc();
+	}
+
+	return new(memory) DisplayPage();
+}
+
+
+static void delete_page(DisplayPage* page)
+{
+	page->~DisplayPage();
+	free(page);
+}
+
+
+// Shared by every blank page of every display.  It is never written to, and
+// isn't reference counted, so it is never freed.
+static DisplayPage* get_blank_page()
+{
+	static DisplayPage* blank = new_page();
+	return blank;
+}
+
 
 Display::Display()
 {
 	width = 64;
 	height = 32;
 
-	display = new bool*[width];
+	blank_page = get_blank_page();
 
-	for(int i=0; i<width; i++)
+	num_pages = 0;
+	for(unsigned int p=0; p<DISPLAY_MAX_PAGES; p++)
 	{
-		display[i] = new bool[height];
-
-		for(int j=0; j<height; j++)
-		{
-			display[i][j] = false;
-		}
+		pages[p] = blank_page;
 	}
-	
+
+	generation = 0;
+
+	kernels = get_display_kernels();
+	allocate();
 }
 
 
@@ -27,100 +60,392 @@ Display::Display(unsigned int _width, unsigned int _height)
 	width = _width;
 	height = _height;
 
-	display = new bool*[width];
+	blank_page = get_blank_page();
 
-	for(int i=0; i<width; i++)
+	num_pages = 0;
+	for(unsigned int p=0; p<DISPLAY_MAX_PAGES; p++)
 	{
-		display[i] = new bool[height];
+		pages[p] = blank_page;
+	}
 
-		for(int j=0; j<height; j++)
+	generation = 0;
+
+	kernels = get_display_kernels();
+	allocate();
+}
+
+
+/*******************
+* Display(const Display* parent)
+*
+* Create a fork of the parent, sharing all of its pages
+*******************/
+Display::Display(const Display* parent)
+{
+	blank_page = parent->blank_page;
+
+	width = parent->width;
+	height = parent->height;
+	words_per_row = parent->words_per_row;
+	rows_per_page = parent->rows_per_page;
+	num_pages = parent->num_pages;
+
+	memcpy(row_page, parent->row_page, sizeof(row_page));
+	memcpy(row_offset, parent->row_offset, sizeof(row_offset));
+
+	for(unsigned int p=0; p<DISPLAY_MAX_PAGES; p++)
+	{
+		pages[p] = parent->pages[p];
+		if(pages[p] != blank_page)
 		{
-			display[i][j] = false;
+			pages[p]->references++;
 		}
 	}
+
+	kernels = parent->kernels;
+	generation = parent->generation;
+}
+
+
+Display::~Display()
+{
+	for(unsigned int p=0; p<DISPLAY_MAX_PAGES; p++)
+	{
+		release_page(p);
+	}
 }
 
+
 /*******************
-* set_pixel(unsigned char x, unsigned char y)
-* 
-* Xor the pixel at point (x,y).  If this sets the pixel to false,
-* then return true, otherwise, return false
+* fork()
+*
+* Create a copy of the display.  No pixels are copied until either display
+* draws on a page.  A display shouldn't be forked while another thread is
+* drawing on it.
 *******************/
-bool Display::set_pixel(unsigned char x, unsigned char y)
+Display* Display::fork()
+{
+	return new Display(this);
+}
+
+
+/*******************
+* set_kernels(const DisplayKernels* kernels)
+*
+* Use a specific set of kernels to scroll the display, e.g., to compare them
+*******************/
+void Display::set_kernels(const DisplayKernels* _kernels)
+{
+	kernels = _kernels;
+}
+
+
+/*******************
+* allocate()
+*
+* Create a blank display of the current width and height.  Every page starts
+* as the blank page, so nothing is allocated until the display is drawn on.
+*******************/
+void Display::allocate()
 {
-	if(display[x][y])
+	// Pixels are addressed by unsigned chars, so anything larger can't be seen
+	if(width > DISPLAY_MAX_SIZE)
 	{
-		display[x][y] = false;
-		return true;
+		width = DISPLAY_MAX_SIZE;
 	}
-	else
+	if(height > DISPLAY_MAX_SIZE)
 	{
-		display[x][y] = true;
-		return false;
+		height = DISPLAY_MAX_SIZE;
+	}
+
+	unsigned int old_num_pages = num_pages;
+
+	words_per_row = (width + 63) / 64;
+	rows_per_page = DISPLAY_PAGE_WORDS / words_per_row;
+	num_pages = (height + rows_per_page - 1) / rows_per_page;
+
+	// Pages past the end of the display are always blank, so clear() only
+	// needs to look at the pages in use
+	for(unsigned int p=num_pages; p<old_num_pages; p++)
+	{
+		release_page(p);
+	}
+
+	for(unsigned int y=0; y<height; y++)
+	{
+		row_page[y] = y / rows_per_page;
+		row_offset[y] = (y % rows_per_page) * words_per_row;
+	}
+
+	clear();
+}
+
+
+/*******************
+* release_page(unsigned int page)
+*
+* Drop this display's reference to the page, and replace it with the blank
+* page
+*******************/
+void Display::release_page(unsigned int p)
+{
+	if(pages[p] != blank_page && --pages[p]->references == 0)
+	{
+		delete_page(pages[p]);
+	}
+
+	pages[p] = blank_page;
+}
+
+
+/*******************
+* own_page(unsigned int page)
+*
+* Make sure the page belongs to this display alone, so it can be written to.
+* A page which is blank, or shared with a fork, is copied first.
+*******************/
+void Display::own_page(unsigned int p)
+{
+	DisplayPage* page = pages[p];
+
+	if(page != blank_page && page->references == 1)
+	{
+		return;
 	}
+
+	DisplayPage* copy = new_page();
+	copy->references = 1;
+	memcpy(copy->words, page->words, sizeof(copy->words));
+
+	release_page(p);
+	pages[p] = copy;
+}
+
+
+/*******************
+* get_page_rows(unsigned int page)
+*
+* The number of rows of the display held in the page;  the last page may not
+* be full
+*******************/
+unsigned int Display::get_page_rows(unsigned int p)
+{
+	if((p + 1) * rows_per_page > height)
+	{
+		return height - p * rows_per_page;
+	}
+
+	return rows_per_page;
+}
+
+
+/*******************
+* get_row(unsigned char y)
+*
+* The words of row y, for reading only
+*******************/
+const uint64_t* Display::get_row(unsigned char y)
+{
+	return &pages[row_page[y]]->words[row_offset[y]];
+}
+
+
+/*******************
+* get_writable_row(unsigned char y)
+*
+* The words of row y, copying its page first if it's shared
+*******************/
+uint64_t* Display::get_writable_row(unsigned char y)
+{
+	DisplayPage* page = pages[row_page[y]];
+
+	if(page == blank_page || page->references != 1)
+	{
+		own_page(row_page[y]);
+		page = pages[row_page[y]];
+	}
+
+	return &page->words[row_offset[y]];
+}
+
+
+/*******************
+* get_mask(unsigned char x)
+*
+* The bit of the pixel at column x within its word
+*******************/
+uint64_t Display::get_mask(unsigned char x)
+{
+	return ((uint64_t) 1) << (63 - (x & 63));
+}
+
+
+/*******************
+* set_pixel(unsigned char x, unsigned char y)
+*
+* Xor the pixel at point (x,y).  If this sets the pixel to false,
+* then return true, otherwise, return false
+*******************/
+bool Display::set_pixel(unsigned char x, unsigned char y)
+{
+	return flip_pixel(x, y);
 }
 
 
 bool Display::flip_pixel(unsigned char x, unsigned char y)
 {
-	display[x][y] = !display[x][y];
+	uint64_t* word = &get_writable_row(y)[x >> 6];
+	uint64_t mask = get_mask(x);
+
+	*word ^= mask;
+	generation++;
 
-	return !display[x][y];
+	return (*word & mask) == 0;
 }
 
 
 bool Display::get_pixel(unsigned char x, unsigned char y)
 {
-	return display[x][y];
+	return (get_row(y)[x >> 6] & get_mask(x)) != 0;
 }
 
 
+/*******************
+* write_line(unsigned char x, unsigned char y, unsigned char value)
+*
+* Xor an 8 pixel sprite line onto the display at point (x,y), with the most
+* significant bit leftmost.  Returns true if any pixel was turned off.
+*******************/
 bool Display::write_line(unsigned char x, unsigned char y, unsigned char value)
 {
-	unsigned char _y = y;
-	unsigned char _x;
-	bool collision = false;
+	return write_bits(x, y, ((uint64_t) value) << 56);
+}
+
+
+/*******************
+* write_wide_line(unsigned char x, unsigned char y, unsigned short value)
+*
+* Xor a 16 pixel sprite line onto the display at point (x,y), with the most
+* significant bit leftmost.  Returns true if any pixel was turned off.
+*******************/
+bool Display::write_wide_line(unsigned char x, unsigned char y, unsigned short value)
+{
+	return write_bits(x, y, ((uint64_t) value) << 48);
+}
+
+
+/*******************
+* write_clipped_line(unsigned char x, unsigned char y, unsigned char value)
+*
+* As write_line(), but pixels past the right side or bottom of the screen are
+* dropped, rather than wrapping around
+*******************/
+bool Display::write_clipped_line(unsigned char x, unsigned char y, unsigned char value)
+{
+	return write_clipped_bits(x, y, ((uint64_t) value) << 56);
+}
+
+
+bool Display::write_clipped_wide_line(unsigned char x, unsigned char y, unsigned short value)
+{
+	return write_clipped_bits(x, y, ((uint64_t) value) << 48);
+}
 
-	// _y may be greater than the display size, wrap around in this case
-	_y = _y % height;
 
-	// Assign each bit in the line, 
-	for(int i=0; i<8; i++)
+/*******************
+* write_bits(unsigned char x, unsigned char y, uint64_t line)
+*
+* Xor up to 16 pixels, aligned to the most significant bit of line, onto the
+* display at point (x,y).  Pixels past the right side of the screen wrap
+* around to the left side of the same row, and rows past the bottom wrap
+* around to the top.  Returns true if any pixel was turned off.
+*******************/
+bool Display::write_bits(unsigned char x, unsigned char y, uint64_t line)
+{
+	// Nothing to draw, so leave the page shared
+	if(line == 0)
 	{
-		bool is_high = ( (value >> (7-i)) & 0x01) == 0x01;
+		return false;
+	}
 
-		// Wrap _x if it is past the right side of the screen
-		_x = x + i;
-		_x = _x % width;
+	generation++;
 
-		if(display[_x][_y] == is_high)
-		{
-			if(is_high)
-			{
-				collision = true;
-			}
-			display[_x][_y] = false;
-		}
-		else
+	// y may be greater than the display size, wrap around in this case
+	unsigned char _y = y % height;
+
+	// If rows are a whole number of words, the line lands in at most two
+	// words, the second of which may wrap around to the start of the row
+	if((width & 63) == 0)
+	{
+		unsigned char _x = x % width;
+
+		unsigned int first = _x >> 6;
+		unsigned int second = (first + 1 == words_per_row) ? 0 : first + 1;
+
+		unsigned int shift = _x & 63;
+		uint64_t first_bits = line >> shift;
+		uint64_t second_bits = shift ? line << (64 - shift) : 0;
+
+		uint64_t* row = get_writable_row(_y);
+		bool collision = ((row[first] & first_bits) | (row[second] & second_bits)) != 0;
+
+		row[first] ^= first_bits;
+		row[second] ^= second_bits;
+
+		return collision;
+	}
+
+	// Otherwise, flip each set pixel in turn
+	bool collision = false;
+
+	for(int i=0; i<16; i++)
+	{
+		if(line & (((uint64_t) 1) << (63 - i)))
 		{
-			display[_x][_y] = true;
-		}
+			// Wrap _x if it is past the right side of the screen
+			unsigned char _x = x + i;
+			_x = _x % width;
 
+			collision = flip_pixel(_x, _y) || collision;
+		}
 	}
-	
+
 	return collision;
 }
 
 
+/*******************
+* write_clipped_bits(unsigned char x, unsigned char y, uint64_t line)
+*
+* Xor up to 16 pixels onto the display at point (x,y), dropping any past the
+* right side of the screen, and the whole line if it's below the bottom.
+* Once clipped, nothing is left to wrap, so the line is drawn as usual.
+*******************/
+bool Display::write_clipped_bits(unsigned char x, unsigned char y, uint64_t line)
+{
+	if(x >= width || y >= height)
+	{
+		return false;
+	}
+
+	if(width - x < 64)
+	{
+		line &= ~((uint64_t) 0) << (64 - (width - x));
+	}
+
+	return write_bits(x, y, line);
+}
+
+
 void Display::show()
 {
 	for(int y=0; y<height; y++)
 	{
 		for(int x=0; x<width; x++)
 		{
-			if(display[x][y])
+			if(get_pixel(x, y))
 			{
-				std::cout << "#"; 
+				std::cout << "#";
 			}
 			else
 			{
@@ -132,13 +457,25 @@ void Display::show()
 }
 
 
+/*******************
+* clear()
+*
+* Blank the display.  Pages belonging to this display alone are kept for
+* reuse, and shared pages are replaced with the blank page.
+*******************/
 void Display::clear()
 {
-	for(int x=0; x<width; x++)
+	generation++;
+
+	for(unsigned int p=0; p<num_pages; p++)
 	{
-		for(int y=0; y<height; y++)
+		if(pages[p] != blank_page && pages[p]->references == 1)
+		{
+			memset(pages[p]->words, 0, get_page_rows(p) * words_per_row * sizeof(uint64_t));
+		}
+		else
 		{
-			display[x][y] = false;
+			release_page(p);
 		}
 	}
 }
@@ -155,104 +492,329 @@ unsigned int Display::get_height()
 	return height;
 }
 
-void Display::resize(unsigned int _width, unsigned int _height)
+
+unsigned int Display::get_words_per_row()
 {
-	// Hang on to the old display
-	bool** old_display = display;
+	return words_per_row;
+}
 
-	// Create a new display, set all values to 0
-	display = new bool*[_width];
 
-	for(int i=0; i<_width; i++)
+/*******************
+* copy_rows(uint64_t* words)
+*
+* Copy the packed pixels of the whole display into words, one row after
+* another, with each row taking get_words_per_row() words
+*******************/
+void Display::copy_rows(uint64_t* words)
+{
+	// Rows are contiguous within a page, so each page is a single copy
+	for(unsigned int p=0; p<num_pages; p++)
 	{
-		display[i] = new bool[_height];
-		for(int j=0; j<_height; j++)
-		{
-			display[i][j] = false;
-		}
+		memcpy(&words[p * rows_per_page * words_per_row], pages[p]->words, get_page_rows(p) * words_per_row * sizeof(uint64_t));
 	}
+}
+
 
-	// Copy over whatever is in the current display, cropping if necessary
-	for(int i=0; i<std::min(_width, width); i++)
+/*******************
+* get_generation()
+*
+* A count which changes whenever the display does
+*******************/
+unsigned long Display::get_generation()
+{
+	return generation;
+}
+
+void Display::resize(unsigned int _width, unsigned int _height)
+{
+	// The screen is cleared when resized, so there's nothing to copy over
+	width = _width;
+	height = _height;
+
+	allocate();
+
+	generation++;
+}
+
+
+void Display::scroll_down(unsigned char num_rows)
+{
+	// Nothing moves (SCHIP 00C0)
+	if(num_rows == 0)
 	{
-		for(int j=0; j<std::min(_height, height); j++)
-		{
-			display[i][j] = old_display[i][j];
-		}
+		return;
 	}
 
-	// Destroy the old display
-	for(int i=0; i<width; i++)
+	generation++;
+
+	if(num_rows >= height)
 	{
-		delete old_display[i];
+		clear();
+		return;
 	}
-	delete old_display;
 
-	old_display = NULL;
+	// Fill the pages from the bottom up, so no row is overwritten before it
+	// has been moved.  The rows moved into a page come from two pages at most.
+	for(int p=num_pages-1; p>=0; p--)
+	{
+		unsigned int first = p * rows_per_page;
+		unsigned int rows = get_page_rows(p);
+
+		// Rows scrolled in from above the top of the screen are blank, the
+		// rest are moved down from the rows starting at source
+		unsigned int blank_rows = first < num_rows ? num_rows - first : 0;
+		if(blank_rows > rows)
+		{
+			blank_rows = rows;
+		}
 
-	// Finally, set the new width and height
-	width = _width;
-	height = _height;
+		unsigned int moved_rows = rows - blank_rows;
+		unsigned int source = first + blank_rows - num_rows;
 
-	// Clear the screen.  NOTE:  Is this what to do?
-	clear();
+		// The moved rows may run over the end of their page into the next
+		unsigned int source_page = 0;
+		unsigned int upper_rows = 0;
+		if(moved_rows > 0)
+		{
+			source_page = row_page[source];
+			upper_rows = (source_page + 1) * rows_per_page - source;
+			if(upper_rows > moved_rows)
+			{
+				upper_rows = moved_rows;
+			}
+		}
+
+		// Only blank rows are moved into the page, so it can be blanked without
+		// being copied
+		if(moved_rows == 0 || (pages[source_page] == blank_page && (upper_rows == moved_rows || pages[source_page + 1] == blank_page)))
+		{
+			if(pages[p] != blank_page && pages[p]->references == 1)
+			{
+				memset(pages[p]->words, 0, rows * words_per_row * sizeof(uint64_t));
+			}
+			else
+			{
+				release_page(p);
+			}
+			continue;
+		}
+
+		own_page(p);
+		uint64_t* words = pages[p]->words;
+
+		// The lower rows may come from this page, so are moved first
+		if(upper_rows < moved_rows)
+		{
+			memmove(&words[(blank_rows + upper_rows) * words_per_row], pages[source_page + 1]->words, (moved_rows - upper_rows) * words_per_row * sizeof(uint64_t));
+		}
+
+		memmove(&words[blank_rows * words_per_row], &pages[source_page]->words[row_offset[source]], upper_rows * words_per_row * sizeof(uint64_t));
+
+		if(blank_rows > 0)
+		{
+			memset(words, 0, blank_rows * words_per_row * sizeof(uint64_t));
+		}
+	}
 }
 
 
-void Display::scroll_down(unsigned char num_rows)
+void Display::scroll_left(unsigned char num_cols)
 {
-	for(int j=height-num_rows-1; j>=0; j--)
+	generation++;
+
+	if(num_cols >= width)
 	{
-		for(int i=0; i<width; i++)
+		clear();
+		return;
+	}
+
+	// Standard display sizes have their own kernels
+	if(num_cols < 64 && width == 64)
+	{
+		for(unsigned int p=0; p<num_pages; p++)
+		{
+			if(pages[p] != blank_page)
+			{
+				own_page(p);
+				kernels->scroll_left_64(pages[p]->words, get_page_rows(p), num_cols);
+			}
+		}
+		return;
+	}
+	if(num_cols < 64 && width == 128)
+	{
+		for(unsigned int p=0; p<num_pages; p++)
 		{
-			display[i][j+num_rows] = display[i][j];
+			if(pages[p] != blank_page)
+			{
+				own_page(p);
+				kernels->scroll_left_128(pages[p]->words, get_page_rows(p), num_cols);
+			}
 		}
+		return;
 	}
 
-	for(int i=0; i<width; i++)
+	unsigned int word_shift = num_cols >> 6;
+	unsigned int bit_shift = num_cols & 63;
+
+	// Shift each row towards the most significant bit of its first word.
+	// Unused bits past the right side of the screen are always clear, so the
+	// vacated columns are filled with blank pixels.
+	for(unsigned int y=0; y<height; y++)
 	{
-		for(int j=0; j<num_rows; j++)
+		uint64_t* row = get_writable_row(y);
+
+		for(unsigned int i=0; i<words_per_row; i++)
 		{
-			display[i][j] = false;
+			uint64_t word = 0;
+
+			if(i + word_shift < words_per_row)
+			{
+				word = row[i + word_shift] << bit_shift;
+			}
+			if(bit_shift && i + word_shift + 1 < words_per_row)
+			{
+				word |= row[i + word_shift + 1] >> (64 - bit_shift);
+			}
+
+			row[i] = word;
 		}
 	}
 }
 
-
-void Display::scroll_left(unsigned char num_cols)
+void Display::scroll_right(unsigned char num_cols)
 {
-	for(int i=num_cols; i<width; i++)
+	generation++;
+
+	if(num_cols >= width)
+	{
+		clear();
+		return;
+	}
+
+	// Standard display sizes have their own kernels
+	if(num_cols < 64 && width == 64)
 	{
-		for(int j=0; j<height; j++)
+		for(unsigned int p=0; p<num_pages; p++)
 		{
-			display[i-num_cols][j] = display[i][j];
+			if(pages[p] != blank_page)
+			{
+				own_page(p);
+				kernels->scroll_right_64(pages[p]->words, get_page_rows(p), num_cols);
+			}
 		}
+		return;
+	}
+	if(num_cols < 64 && width == 128)
+	{
+		for(unsigned int p=0; p<num_pages; p++)
+		{
+			if(pages[p] != blank_page)
+			{
+				own_page(p);
+				kernels->scroll_right_128(pages[p]->words, get_page_rows(p), num_cols);
+			}
+		}
+		return;
+	}
+
+	unsigned int word_shift = num_cols >> 6;
+	unsigned int bit_shift = num_cols & 63;
+
+	// Pixels shifted past the right side of the screen need to be cleared
+	// from the unused bits of the last word
+	uint64_t last_word_mask = ~((uint64_t) 0);
+	if(width & 63)
+	{
+		last_word_mask <<= 64 - (width & 63);
 	}
 
-	for(int i=width-num_cols; i<width; i++)
+	// Shift each row towards the least significant bit of its last word
+	for(unsigned int y=0; y<height; y++)
 	{
-		for(int j=0; j<height; j++)
+		uint64_t* row = get_writable_row(y);
+
+		for(int i=words_per_row-1; i>=0; i--)
 		{
-			display[i][j] = false;
+			uint64_t word = 0;
+
+			if(i >= (int) word_shift)
+			{
+				word = row[i - word_shift] >> bit_shift;
+			}
+			if(bit_shift && i >= (int) word_shift + 1)
+			{
+				word |= row[i - word_shift - 1] << (64 - bit_shift);
+			}
+
+			row[i] = word;
 		}
+
+		row[words_per_row - 1] &= last_word_mask;
 	}
 }
 
-void Display::scroll_right(unsigned char num_cols)
+
+/*******************
+* save(Snapshot* snapshot)
+*
+* Write the size and contents of the display to the snapshot
+*******************/
+void Display::save(Snapshot* snapshot)
 {
-	for(int i=width-num_cols-1; i>=0; i--)
+	snapshot->begin_section(DISPLAY_SECTION);
+	snapshot->write_short(width);
+	snapshot->write_short(height);
+
+	for(unsigned int y=0; y<height; y++)
 	{
-		for(int j=0; j<height; j++)
+		const uint64_t* row = get_row(y);
+		for(unsigned int i=0; i<words_per_row; i++)
 		{
-			display[i+num_cols][j] = display[i][j];
+			snapshot->write_word(row[i]);
 		}
 	}
 
-	for(int i=0; i<num_cols; i++)
+	snapshot->end_section();
+}
+
+
+/*******************
+* restore(Snapshot* snapshot)
+*
+* Replace the display with the one in the snapshot, resizing it if needed.
+* Returns false if the snapshot doesn't hold a valid display.
+*******************/
+bool Display::restore(Snapshot* snapshot)
+{
+	if(!snapshot->open_section(DISPLAY_SECTION))
+	{
+		return false;
+	}
+
+	unsigned int _width = snapshot->read_short();
+	unsigned int _height = snapshot->read_short();
+
+	// Pixels are addressed by unsigned chars, so anything larger is corrupt
+	if(!snapshot->is_valid() || _width == 0 || _width > 256 || _height == 0 || _height > 256)
+	{
+		return false;
+	}
+
+	if(_width != width || _height != height)
 	{
-		for(int j=0; j<height; j++)
+		resize(_width, _height);
+	}
+
+	for(unsigned int y=0; y<height; y++)
+	{
+		uint64_t* row = get_writable_row(y);
+		for(unsigned int i=0; i<words_per_row; i++)
 		{
-			display[i][j] = false;
+			row[i] = snapshot->read_word();
 		}
 	}
-}
\ No newline at end of file
+	generation++;
+
+	return snapshot->close_section();
+}
@@ -0,0 +1,273 @@
+#include "core/display_kernels.h"
+
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISPLAY_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+/*******************
+* Scalar kernels
+*
+* Rows are shifted a word at a time.  In a two word row, the first word holds
+* the left half of the row, so pixels carry between the words.
+*******************/
+static void scroll_left_64_scalar(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	for(unsigned int i=0; i<num_rows; i++)
+	{
+		display[i] <<= num_cols;
+	}
+}
+
+
+static void scroll_right_64_scalar(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	for(unsigned int i=0; i<num_rows; i++)
+	{
+		display[i] >>= num_cols;
+	}
+}
+
+
+static void scroll_left_128_scalar(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	if(num_cols == 0)
+	{
+		return;
+	}
+
+	for(unsigned int i=0; i<2*num_rows; i+=2)
+	{
+		display[i] = (display[i] << num_cols) | (display[i+1] >> (64 - num_cols));
+		display[i+1] <<= num_cols;
+	}
+}
+
+
+static void scroll_right_128_scalar(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	if(num_cols == 0)
+	{
+		return;
+	}
+
+	for(unsigned int i=0; i<2*num_rows; i+=2)
+	{
+		display[i+1] = (display[i+1] >> num_cols) | (display[i] << (64 - num_cols));
+		display[i] >>= num_cols;
+	}
+}
+
+
+static const DisplayKernels scalar_kernels = {
+	"scalar",
+	scroll_left_64_scalar, scroll_right_64_scalar,
+	scroll_left_128_scalar, scroll_right_128_scalar
+};
+
+
+#ifdef DISPLAY_KERNELS_X86
+
+/*******************
+* SSE2 kernels
+*
+* A 128 bit register holds two rows of a 64 pixel display, or one row of a
+* 128 pixel display.  For the latter, each word is shifted, and the bits
+* shifted out of one word are moved across to the other with a byte shift of
+* the whole register.  Shift counts of 64 give zero, so no pixels carry when
+* the display isn't being shifted.
+*******************/
+__attribute__((target("sse2")))
+static void scroll_left_64_sse2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+
+	unsigned int i = 0;
+	for(; i+2 <= num_rows; i+=2)
+	{
+		__m128i rows = _mm_loadu_si128((__m128i*) &display[i]);
+		_mm_storeu_si128((__m128i*) &display[i], _mm_sll_epi64(rows, shift));
+	}
+	scroll_left_64_scalar(&display[i], num_rows - i, num_cols);
+}
+
+
+__attribute__((target("sse2")))
+static void scroll_right_64_sse2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+
+	unsigned int i = 0;
+	for(; i+2 <= num_rows; i+=2)
+	{
+		__m128i rows = _mm_loadu_si128((__m128i*) &display[i]);
+		_mm_storeu_si128((__m128i*) &display[i], _mm_srl_epi64(rows, shift));
+	}
+	scroll_right_64_scalar(&display[i], num_rows - i, num_cols);
+}
+
+
+__attribute__((target("sse2")))
+static void scroll_left_128_sse2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+	__m128i carry_shift = _mm_cvtsi32_si128(64 - num_cols);
+
+	for(unsigned int i=0; i<2*num_rows; i+=2)
+	{
+		__m128i row = _mm_loadu_si128((__m128i*) &display[i]);
+		__m128i carry = _mm_srli_si128(_mm_srl_epi64(row, carry_shift), 8);
+		_mm_storeu_si128((__m128i*) &display[i], _mm_or_si128(_mm_sll_epi64(row, shift), carry));
+	}
+}
+
+
+__attribute__((target("sse2")))
+static void scroll_right_128_sse2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+	__m128i carry_shift = _mm_cvtsi32_si128(64 - num_cols);
+
+	for(unsigned int i=0; i<2*num_rows; i+=2)
+	{
+		__m128i row = _mm_loadu_si128((__m128i*) &display[i]);
+		__m128i carry = _mm_slli_si128(_mm_sll_epi64(row, carry_shift), 8);
+		_mm_storeu_si128((__m128i*) &display[i], _mm_or_si128(_mm_srl_epi64(row, shift), carry));
+	}
+}
+
+
+static const DisplayKernels sse2_kernels = {
+	"sse2",
+	scroll_left_64_sse2, scroll_right_64_sse2,
+	scroll_left_128_sse2, scroll_right_128_sse2
+};
+
+
+/*******************
+* AVX2 kernels
+*
+* As SSE2, with four rows of a 64 pixel display, or two rows of a 128 pixel
+* display, per register.  The byte shifts work within each 128 bit lane, so
+* pixels never carry between the two rows.
+*******************/
+__attribute__((target("avx2")))
+static void scroll_left_64_avx2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+
+	unsigned int i = 0;
+	for(; i+4 <= num_rows; i+=4)
+	{
+		__m256i rows = _mm256_loadu_si256((__m256i*) &display[i]);
+		_mm256_storeu_si256((__m256i*) &display[i], _mm256_sll_epi64(rows, shift));
+	}
+	scroll_left_64_scalar(&display[i], num_rows - i, num_cols);
+}
+
+
+__attribute__((target("avx2")))
+static void scroll_right_64_avx2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+
+	unsigned int i = 0;
+	for(; i+4 <= num_rows; i+=4)
+	{
+		__m256i rows = _mm256_loadu_si256((__m256i*) &display[i]);
+		_mm256_storeu_si256((__m256i*) &display[i], _mm256_srl_epi64(rows, shift));
+	}
+	scroll_right_64_scalar(&display[i], num_rows - i, num_cols);
+}
+
+
+__attribute__((target("avx2")))
+static void scroll_left_128_avx2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+	__m128i carry_shift = _mm_cvtsi32_si128(64 - num_cols);
+
+	unsigned int i = 0;
+	for(; i+2 <= num_rows; i+=2)
+	{
+		__m256i rows = _mm256_loadu_si256((__m256i*) &display[2*i]);
+		__m256i carry = _mm256_srli_si256(_mm256_srl_epi64(rows, carry_shift), 8);
+		_mm256_storeu_si256((__m256i*) &display[2*i], _mm256_or_si256(_mm256_sll_epi64(rows, shift), carry));
+	}
+	scroll_left_128_scalar(&display[2*i], num_rows - i, num_cols);
+}
+
+
+__attribute__((target("avx2")))
+static void scroll_right_128_avx2(uint64_t* display, unsigned int num_rows, unsigned int num_cols)
+{
+	__m128i shift = _mm_cvtsi32_si128(num_cols);
+	__m128i carry_shift = _mm_cvtsi32_si128(64 - num_cols);
+
+	unsigned int i = 0;
+	for(; i+2 <= num_rows; i+=2)
+	{
+		__m256i rows = _mm256_loadu_si256((__m256i*) &display[2*i]);
+		__m256i carry = _mm256_slli_si256(_mm256_sll_epi64(rows, carry_shift), 8);
+		_mm256_storeu_si256((__m256i*) &display[2*i], _mm256_or_si256(_mm256_srl_epi64(rows, shift), carry));
+	}
+	scroll_right_128_scalar(&display[2*i], num_rows - i, num_cols);
+}
+
+
+static const DisplayKernels avx2_kernels = {
+	"avx2",
+	scroll_left_64_avx2, scroll_right_64_avx2,
+	scroll_left_128_avx2, scroll_right_128_avx2
+};
+
+#endif
+
+
+const DisplayKernels* get_display_kernels(DisplayKernelSet kernel_set)
+{
+	switch(kernel_set)
+	{
+		case SCALAR_KERNELS:
+			return &scalar_kernels;
+
+#ifdef DISPLAY_KERNELS_X86
+		case SSE2_KERNELS:
+			return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+
+		case AVX2_KERNELS:
+			return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+
+		default:
+			return NULL;
+	}
+}
+
+
+static const DisplayKernels* choose_display_kernels()
+{
+	const DisplayKernels* kernels = get_display_kernels(AVX2_KERNELS);
+
+	if(!kernels)
+	{
+		kernels = get_display_kernels(SSE2_KERNELS);
+	}
+	if(!kernels)
+	{
+		kernels = get_display_kernels(SCALAR_KERNELS);
+	}
+
+	return kernels;
+}
+
+
+const DisplayKernels* get_display_kernels()
+{
+	static const DisplayKernels* best_kernels = choose_display_kernels();
+
+	return best_kernels;
+}
@@ -0,0 +1,82 @@
+#include "core/frame_buffer.h"
+
+/************
+*
+* Create a frame buffer for the display, holding its current contents
+************/
+FrameBuffer::FrameBuffer(Display* _display)
+{
+	display = _display;
+
+	back = 0;
+	middle = 1;
+	front = 2;
+
+	for(int i=0; i<3; i++)
+	{
+		frames[i].width = 0;
+		frames[i].height = 0;
+		frames[i].words_per_row = 0;
+		frames[i].generation = 0;
+	}
+
+	// Copy the display straight to the front, so there's always a frame to
+	// draw, and the first publish() only copies if the display has changed
+	Frame* frame = &frames[front];
+	frame->width = display->get_width();
+	frame->height = display->get_height();
+	frame->words_per_row = display->get_words_per_row();
+	frame->generation = display->get_generation();
+	display->copy_rows(frame->words);
+
+	published_generation = frame->generation;
+}
+
+
+/************
+* publish()
+*
+* Copy the display into the back frame, and make it the newest complete
+* frame, if the display has changed since it was last published.  Should only
+* be called from the thread running the chip, between instructions.  Returns
+* true if a frame was published.
+************/
+bool FrameBuffer::publish()
+{
+	unsigned long generation = display->get_generation();
+
+	if(generation == published_generation)
+	{
+		return false;
+	}
+
+	Frame* frame = &frames[back];
+	frame->width = display->get_width();
+	frame->height = display->get_height();
+	frame->words_per_row = display->get_words_per_row();
+	frame->generation = generation;
+	display->copy_rows(frame->words);
+
+	published_generation = generation;
+	back = middle.exchange(back | FRAME_BUFFER_FRESH, std::memory_order_acq_rel) & FRAME_BUFFER_INDEX;
+
+	return true;
+}
+
+
+/************
+* take()
+*
+* Get the newest complete frame.  If no frame has been published since the
+* last call, the same frame is returned again.  The frame may be read until
+* the next call.  Should only be called from the drawing thread.
+************/
+const Frame* FrameBuffer::take()
+{
+	if(middle.load(std::memory_order_acquire) & FRAME_BUFFER_FRESH)
+	{
+		front = middle.exchange(front, std::memory_order_acq_rel) & FRAME_BUFFER_INDEX;
+	}
+
+	return &frames[front];
+}
@@ -0,0 +1,395 @@
+#include "core/host.h"
+#include "core/clock.h"
+
+#include <iostream>
+
+/************
+*
+* Create a host with one worker per core
+************/
+Host::Host()
+{
+	create_workers(std::thread::hardware_concurrency());
+}
+
+
+/************
+*
+* Create a host with the given number of workers
+************/
+Host::Host(unsigned int num_workers)
+{
+	create_workers(num_workers);
+}
+
+
+Host::~Host()
+{
+	stop();
+
+	for(unsigned int i=0; i<workers.size(); i++)
+	{
+		delete workers[i];
+	}
+
+	for(unsigned int i=0; i<computers.size(); i++)
+	{
+		delete computers[i];
+	}
+}
+
+
+void Host::create_workers(unsigned int num_workers)
+{
+	if(num_workers == 0)
+	{
+		num_workers = 1;
+	}
+
+	for(unsigned int i=0; i<num_workers; i++)
+	{
+		HostWorker* worker = new HostWorker;
+		worker->lag = 0.0;
+		worker->frames_behind = 0.0;
+		worker->behind = false;
+		worker->frames_run = 0;
+		worker->computers_stolen = 0;
+
+		workers.push_back(worker);
+	}
+
+	exists = false;
+	started = false;
+	listener = NULL;
+}
+
+
+/************
+* add(Computer* computer)
+*
+* Add a computer to the worker with the fewest computers.  The computer must
+* have a clock, which should not be started.
+************/
+void Host::add(Computer* computer)
+{
+	HostedComputer* hosted = new HostedComputer;
+	hosted->computer = computer;
+	hosted->next_frame = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(computers_mutex);
+		computers.push_back(hosted);
+	}
+
+	HostWorker* least_loaded = workers[0];
+	size_t least_load = (size_t) -1;
+
+	for(unsigned int i=0; i<workers.size(); i++)
+	{
+		std::lock_guard<std::mutex> lock(workers[i]->queue_mutex);
+		if(workers[i]->queue.size() < least_load)
+		{
+			least_loaded = workers[i];
+			least_load = workers[i]->queue.size();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(least_loaded->queue_mutex);
+	least_loaded->queue.push_back(hosted);
+}
+
+
+/************
+* add_listener(HostListener* listener)
+*
+* The listener is informed from the worker threads
+************/
+void Host::add_listener(HostListener* _listener)
+{
+	listener = _listener;
+}
+
+
+void Host::start()
+{
+	if(started)
+	{
+		return;
+	}
+
+	exists = true;
+	started = true;
+
+	for(unsigned int i=0; i<workers.size(); i++)
+	{
+		workers[i]->thread = std::thread(&Host::runWorker, this, i);
+	}
+}
+
+
+void Host::stop()
+{
+	exists = false;
+
+	for(unsigned int i=0; i<workers.size(); i++)
+	{
+		if(workers[i]->thread.joinable())
+		{
+			workers[i]->thread.join();
+		}
+	}
+
+	started = false;
+}
+
+
+/************
+* take_computer(unsigned int worker)
+*
+* Take the computer at the front of the worker's queue, or try to steal one
+* if the queue is empty
+************/
+HostedComputer* Host::take_computer(unsigned int worker_num)
+{
+	HostWorker* worker = workers[worker_num];
+
+	{
+		std::lock_guard<std::mutex> lock(worker->queue_mutex);
+		if(!worker->queue.empty())
+		{
+			HostedComputer* computer = worker->queue.front();
+			worker->queue.pop_front();
+			return computer;
+		}
+	}
+
+	return steal_computer(worker_num);
+}
+
+
+/************
+* steal_computer(unsigned int worker)
+*
+* Steal a computer from the back of another worker's queue.  Only steal from
+* a worker with at least two more computers than this worker, or with more
+* computers if it has fallen behind (and this one hasn't), so computers don't
+* bounce back and forth between workers.
+************/
+HostedComputer* Host::steal_computer(unsigned int worker_num)
+{
+	size_t own_load;
+	{
+		std::lock_guard<std::mutex> lock(workers[worker_num]->queue_mutex);
+		own_load = workers[worker_num]->queue.size();
+	}
+
+	for(unsigned int i=1; i<workers.size(); i++)
+	{
+		HostWorker* victim = workers[(worker_num + i) % workers.size()];
+
+		std::lock_guard<std::mutex> lock(victim->queue_mutex);
+
+		size_t load = victim->queue.size();
+
+		if(load > own_load + 1 || (victim->behind && !workers[worker_num]->behind && load > own_load))
+		{
+			HostedComputer* computer = victim->queue.back();
+			victim->queue.pop_back();
+			workers[worker_num]->computers_stolen++;
+			return computer;
+		}
+	}
+
+	return NULL;
+}
+
+
+void Host::return_computer(unsigned int worker_num, HostedComputer* computer)
+{
+	std::lock_guard<std::mutex> lock(workers[worker_num]->queue_mutex);
+	workers[worker_num]->queue.push_back(computer);
+}
+
+
+/************
+* run_computer(unsigned int worker, HostedComputer* computer, time_point& earliest)
+*
+* Run a frame of the computer, if it's running and the frame is due.  Returns
+* true if a frame was run.  Otherwise, earliest is brought forward to when the
+* frame is due, if that's sooner.
+************/
+bool Host::run_computer(unsigned int worker_num, HostedComputer* computer, std::chrono::steady_clock::time_point& earliest)
+{
+	Clock* clock = computer->computer->get_clock();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	// Paused computers start again from when they are resumed
+	if(!clock->is_running())
+	{
+		computer->next_frame = now;
+		return false;
+	}
+
+	if(clock->get_pacing() == UNTHROTTLED)
+	{
+		computer->computer->run_frame();
+		computer->next_frame = now;
+		workers[worker_num]->frames_run++;
+		return true;
+	}
+
+	if(computer->next_frame > now)
+	{
+		if(computer->next_frame < earliest)
+		{
+			earliest = computer->next_frame;
+		}
+		return false;
+	}
+
+	std::chrono::duration<double> frame_period(1.0 / (FRAMES_PER_SECOND * clock->get_speed()));
+	std::chrono::duration<double> lateness = now - computer->next_frame;
+
+	computer->computer->run_frame();
+	workers[worker_num]->frames_run++;
+
+	update_lag(worker_num, lateness.count(), frame_period.count());
+
+	// As with the clock, don't try to catch up on frames lost too long ago
+	computer->next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_period);
+	if(now - computer->next_frame > MAX_FRAMES_BEHIND * frame_period)
+	{
+		computer->next_frame = now;
+	}
+
+	return true;
+}
+
+
+/************
+* update_lag(unsigned int worker, double lateness, double frame_period)
+*
+* Record how late the worker ran a frame, and inform the listener if the
+* worker has fallen more than a frame behind, or caught back up.  Lateness is
+* averaged over recent frames, so a single late frame doesn't count.
+************/
+void Host::update_lag(unsigned int worker_num, double lateness, double frame_period)
+{
+	HostWorker* worker = workers[worker_num];
+
+	worker->lag = worker->lag + (lateness - worker->lag) / HOST_LAG_FRAMES;
+	worker->frames_behind = worker->frames_behind + (lateness / frame_period - worker->frames_behind) / HOST_LAG_FRAMES;
+
+	if(!worker->behind && worker->frames_behind > 1.0)
+	{
+		worker->behind = true;
+		if(listener)
+		{
+			listener->worker_falling_behind(worker_num, worker->lag);
+		}
+	}
+	else if(worker->behind && worker->frames_behind < 0.25)
+	{
+		worker->behind = false;
+		if(listener)
+		{
+			listener->worker_caught_up(worker_num);
+		}
+	}
+}
+
+
+/************
+* runWorker(unsigned int worker)
+*
+* Run frames of the worker's computers as they come due.  Once the worker has
+* been through its whole queue without any frame being due, it helps any
+* other worker which needs it, or sleeps until the next frame is due.
+************/
+void Host::runWorker(unsigned int worker_num)
+{
+	HostWorker* worker = workers[worker_num];
+
+	std::chrono::steady_clock::time_point earliest = std::chrono::steady_clock::time_point::max();
+	size_t idle = 0;
+
+	while(exists)
+	{
+		HostedComputer* computer = take_computer(worker_num);
+
+		if(!computer)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(HOST_IDLE_PERIOD_MICROSECONDS));
+			continue;
+		}
+
+		bool ran = run_computer(worker_num, computer, earliest);
+		return_computer(worker_num, computer);
+
+		if(ran)
+		{
+			idle = 0;
+			earliest = std::chrono::steady_clock::time_point::max();
+			continue;
+		}
+
+		idle++;
+
+		size_t load;
+		{
+			std::lock_guard<std::mutex> lock(worker->queue_mutex);
+			load = worker->queue.size();
+		}
+
+		if(idle < load)
+		{
+			continue;
+		}
+
+		// Nothing is due, so take some work from a busier worker, and look at
+		// that first
+		HostedComputer* stolen = steal_computer(worker_num);
+		if(stolen)
+		{
+			std::lock_guard<std::mutex> lock(worker->queue_mutex);
+			worker->queue.push_front(stolen);
+		}
+		else
+		{
+			std::chrono::steady_clock::time_point wake = std::chrono::steady_clock::now() + std::chrono::microseconds(HOST_IDLE_PERIOD_MICROSECONDS);
+			if(earliest < wake)
+			{
+				wake = earliest;
+			}
+
+			std::this_thread::sleep_until(wake);
+		}
+
+		idle = 0;
+		earliest = std::chrono::steady_clock::time_point::max();
+	}
+}
+
+
+unsigned int Host::get_num_workers()
+{
+	return workers.size();
+}
+
+
+double Host::get_worker_lag(unsigned int worker_num)
+{
+	return workers[worker_num]->lag;
+}
+
+
+unsigned long Host::get_frames_run(unsigned int worker_num)
+{
+	return workers[worker_num]->frames_run;
+}
+
+
+unsigned long Host::get_computers_stolen(unsigned int worker_num)
+{
+	return workers[worker_num]->computers_stolen;
+}
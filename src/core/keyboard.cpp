@@ -8,6 +8,21 @@ Keyboard::Keyboard()
 	{
 		keys[i] = false;
 	}
+
+	pending = 0;
+	latched = false;
+}
+
+
+Keyboard::Keyboard(const Keyboard& other)
+{
+	for(int i=0; i<=0x0F; i++)
+	{
+		keys[i] = other.keys[i];
+	}
+
+	pending = other.pending.load();
+	latched = other.latched.load();
 }
 
 bool Keyboard::is_key_pressed(unsigned char key)
@@ -17,10 +32,140 @@ bool Keyboard::is_key_pressed(unsigned char key)
 
 void Keyboard::press_key(unsigned char key)
 {
-	keys[key] = true;
+	pending |= 1 << key;
+
+	if(!latched)
+	{
+		keys[key] = true;
+	}
 }
 
 void Keyboard::release_key(unsigned char key)
 {
+	pending &= ~(1 << key);
+
+	if(!latched)
+	{
+		keys[key] = false;
+	}
+}
+
+
+/*******************
+* consume_key(unsigned char key)
+*
+* Release a key once the program has read it (FX0A), even when latched, so it
+* isn't seen again before the next latch.  Only the chip calls this, so a
+* replay consumes keys at the same instructions as the recording did.
+*******************/
+void Keyboard::consume_key(unsigned char key)
+{
+	pending &= ~(1 << key);
 	keys[key] = false;
-}
\ No newline at end of file
+}
+
+
+/*******************
+* get_key_mask()
+*
+* Which keys are pressed, as a mask with bit n set if key n is pressed
+*******************/
+unsigned short Keyboard::get_key_mask()
+{
+	unsigned short mask = 0;
+	for(int i=0; i<=0x0F; i++)
+	{
+		if(keys[i])
+		{
+			mask |= 1 << i;
+		}
+	}
+
+	return mask;
+}
+
+
+/*******************
+* set_key_mask(unsigned short mask)
+*
+* Press exactly the keys in the mask, e.g., when playing back a replay
+*******************/
+void Keyboard::set_key_mask(unsigned short mask)
+{
+	for(int i=0; i<=0x0F; i++)
+	{
+		keys[i] = (mask & (1 << i)) != 0;
+	}
+
+	pending = mask;
+}
+
+
+/*******************
+* set_latched(bool latched)
+*
+* Hold presses and releases until latch() is called, or apply them
+* immediately
+*******************/
+void Keyboard::set_latched(bool _latched)
+{
+	latched = _latched;
+
+	if(!latched)
+	{
+		latch();
+	}
+}
+
+
+/*******************
+* latch()
+*
+* Apply the presses and releases held since the last latch
+*******************/
+void Keyboard::latch()
+{
+	unsigned short mask = pending;
+
+	for(int i=0; i<=0x0F; i++)
+	{
+		keys[i] = (mask & (1 << i)) != 0;
+	}
+}
+
+
+/*******************
+* save(Snapshot* snapshot)
+*
+* Write which keys are pressed to the snapshot, as a mask with bit n set if
+* key n is pressed
+*******************/
+void Keyboard::save(Snapshot* snapshot)
+{
+	snapshot->begin_section(KEYBOARD_SECTION);
+	snapshot->write_short(get_key_mask());
+	snapshot->end_section();
+}
+
+
+bool Keyboard::restore(Snapshot* snapshot)
+{
+	if(!snapshot->open_section(KEYBOARD_SECTION))
+	{
+		return false;
+	}
+
+	unsigned short mask = snapshot->read_short();
+
+	if(!snapshot->close_section())
+	{
+		return false;
+	}
+
+	for(int i=0; i<=0x0F; i++)
+	{
+		keys[i] = (mask & (1 << i)) != 0;
+	}
+
+	return true;
+}
@@ -1,4 +1,5 @@
 #include "core/memory.h"
+#include "core/snapshot.h"
 
 #include <iostream>
 #include <iomanip>
@@ -6,6 +7,8 @@
 #include <string>
 #include <sstream>
 
+#include <string.h>
+
 /*****************
 * Memory()
 *
@@ -18,12 +21,13 @@
 Memory::Memory()
 {
 	// Allocate 4K of memory to the heap
-	memory_size = 0x1000;
-	memory = new unsigned char[memory_size];
+	memory_size = MEMORY_SIZE;
 
-	for(int i=0; i<memory_size; i++)
+	for(int i=0; i<MEMORY_PAGES; i++)
 	{
-		memory[i] = 0x00;
+		pages[i] = new MemoryPage;
+		pages[i]->references = 1;
+		memset(pages[i]->data, 0x00, MEMORY_PAGE_SIZE);
 	}
 
 	_system_memory_start = 0x000;
@@ -36,6 +40,96 @@ Memory::Memory()
 	_big_sprite_memory_start = 0x050;
 	load_sprites();	
 	load_big_sprites();
+
+	listener = NULL;
+	violations = 0;
+
+	mark_all_dirty();
+}
+
+
+/*****************
+* Memory(const Memory* parent)
+*
+* Create a fork of the parent memory, sharing all of its pages.  A page is
+* only copied when either memory writes to it.
+*/
+Memory::Memory(const Memory* parent)
+{
+	memory_size = parent->memory_size;
+
+	for(int i=0; i<MEMORY_PAGES; i++)
+	{
+		pages[i] = parent->pages[i];
+		pages[i]->references++;
+	}
+
+	_system_memory_start = parent->_system_memory_start;
+	_ram_start = parent->_ram_start;
+	_call_stack_start = parent->_call_stack_start;
+	_display_refresh_start = parent->_display_refresh_start;
+
+	_sprite_memory_start = parent->_sprite_memory_start;
+	_big_sprite_memory_start = parent->_big_sprite_memory_start;
+
+	listener = NULL;
+	violations = 0;
+
+	// Nothing has rendered the fork yet
+	mark_all_dirty();
+}
+
+
+Memory::~Memory()
+{
+	for(int i=0; i<MEMORY_PAGES; i++)
+	{
+		if(--pages[i]->references == 0)
+		{
+			delete pages[i];
+		}
+	}
+}
+
+
+/*****************
+* fork()
+*
+* Create a copy of this memory, which shares pages with it until they are
+* written.  The fork has no listener.
+*/
+Memory* Memory::fork()
+{
+	return new Memory(this);
+}
+
+
+/*****************
+* get_writable(unsigned short address)
+*
+* Get a pointer to the byte at the address which can be written to, first
+* copying its page if the page is shared with another memory.
+*/
+unsigned char* Memory::get_writable(unsigned short address)
+{
+	MemoryPage*& page = pages[address / MEMORY_PAGE_SIZE];
+
+	if(page->references > 1)
+	{
+		MemoryPage* copy = new MemoryPage;
+		copy->references = 1;
+		memcpy(copy->data, page->data, MEMORY_PAGE_SIZE);
+
+		// The other memories sharing the page may have released it meanwhile
+		if(--page->references == 0)
+		{
+			delete page;
+		}
+
+		page = copy;
+	}
+
+	return &page->data[address % MEMORY_PAGE_SIZE];
 }
 
 
@@ -59,7 +153,7 @@ void Memory::load_sprites()
 									 0xF0,0x80,0xF0,0x80,0x80};		// F
 	for(int i=0; i<80; i++)
 	{
-		memory[_sprite_memory_start + i] = sprite_list[i];
+		*get_writable(_sprite_memory_start + i) = sprite_list[i];
 	}
 }
 
@@ -80,54 +174,142 @@ void Memory::load_big_sprites()
 
 	for(int i=0; i<100; i++)
 	{
-		memory[_big_sprite_memory_start + i] = sprite_list[i];
+		*get_writable(_big_sprite_memory_start + i) = sprite_list[i];
 	}
 }
 
 /*******************
-* unsigned char fetch(short address)
+* void write(unsigned short address, const unsigned char* data, unsigned int size)
 *
-* Return the byte at the give address in memory
+* Write a run of bytes starting at the provided address, as if each was
+* dumped in turn, but informing the listener once for the whole run.  Bytes
+* which fall outside of RAM are dropped.
 *
 * Parameters:
-*   address - memory location to retrieve a byte from
+*   address - memory location to write the first byte to, wrapped around the
+*             end of memory
+*   data    - bytes to write
+*   size    - number of bytes to write
+*******************/
+void Memory::write(unsigned short address, const unsigned char* data, unsigned int size)
+{
+#ifdef CHECKED_MEMORY
+	if(address + size > MEMORY_SIZE)
+	{
+		violations += address > MEMORY_ADDRESS_MASK ? size : address + size - MEMORY_SIZE;
+	}
+#endif
+
+	// The run may wrap around the end of memory into the interpreter's memory
+	while(size > 0)
+	{
+		address &= MEMORY_ADDRESS_MASK;
+
+		unsigned int num_bytes = MEMORY_SIZE - address;
+		if(num_bytes > size)
+		{
+			num_bytes = size;
+		}
+
+		// The interpreter's memory can't be written
+		if(address < _ram_start)
+		{
+			if(num_bytes > (unsigned int) (_ram_start - address))
+			{
+				num_bytes = _ram_start - address;
+			}
+
+#ifdef CHECKED_MEMORY
+			violations += num_bytes;
+#endif
+		}
+		else
+		{
+			copy_to_pages(address, data, num_bytes);
+			mark_dirty(address, num_bytes);
+
+			if(listener)
+			{
+				listener->memory_written(address, num_bytes);
+			}
+		}
+
+		address += num_bytes;
+		data += num_bytes;
+		size -= num_bytes;
+	}
+}
+
+
+/*******************
+* unsigned int load_program(const unsigned char* data, unsigned int size)
+*
+* Copy a program into RAM in one go, truncating anything which won't fit.
+* The listener is informed once, as if memory had been restored, rather than
+* of every byte written.
 *
 * Return:
-*   value at the provided memory address
-******************/
-unsigned char Memory::fetch(unsigned short address)
+*   number of bytes loaded
+*******************/
+unsigned int Memory::load_program(const unsigned char* data, unsigned int size)
 {
-	// NOTE: May need to worry about illegal access?
+	if(size > (unsigned int) (memory_size - _ram_start))
+	{
+		size = memory_size - _ram_start;
+	}
+
+	copy_to_pages(_ram_start, data, size);
+	mark_dirty(_ram_start, size);
 
-	// Check to see if the address is within the memory size
-	if(address >= memory_size)
+	if(listener)
 	{
-		std::cout << "MEMORY ERROR: Attemping to access memory address " << address << ", memory size " << (unsigned short) memory_size << std::endl;
-		return 0;			// What else to do?
+		listener->memory_restored();
 	}
 
-	return memory[address];
+	return size;
 }
 
+
 /*******************
-* void dump(short address, char value)
+* copy_to_pages(unsigned short address, const unsigned char* data, unsigned int size)
 *
-* Write the byte to the provided address
-*
-* Parameters:
-*   address - memory location to write to
-*   value   - byte value to write
+* Copy the bytes into memory, with a memcpy for each page they fall in.  The
+* bytes must fit in memory.
 *******************/
-void Memory::dump(unsigned short address, unsigned char value)
+void Memory::copy_to_pages(unsigned short address, const unsigned char* data, unsigned int size)
 {
-	// Check to see if the address is a writable location.
-	if(address < _ram_start)
+	while(size > 0)
 	{
-		std::cout << "MEMORY ERROR: Attempting to write to memory address " << address << std::endl;
-		return;
+		unsigned int num_bytes = MEMORY_PAGE_SIZE - address % MEMORY_PAGE_SIZE;
+		if(num_bytes > size)
+		{
+			num_bytes = size;
+		}
+
+		memcpy(get_writable(address), data, num_bytes);
+
+		address += num_bytes;
+		data += num_bytes;
+		size -= num_bytes;
 	}
+}
+
+
+void Memory::add_listener(MemoryListener* _listener)
+{
+	listener = _listener;
+}
+
 
-	memory[address] = value;
+/*******************
+* get_violations()
+*
+* The number of accesses outside of memory, and writes outside of RAM, so
+* far.  Always 0 unless built with CHECKED_MEMORY.
+*******************/
+unsigned long Memory::get_violations()
+{
+	return violations;
 }
 
 
@@ -151,7 +333,7 @@ void Memory::print_memory(unsigned short address, unsigned short num_bytes)
 {
 	for(unsigned short i=address; i<address+num_bytes; i++)
 	{
-		std::cout << std::setw(2) << std::hex << (unsigned short) memory[i] << " ";
+		std::cout << std::setw(2) << std::hex << (unsigned short) fetch(i) << " ";
 	}
 	std::cout << std::endl;
 }
@@ -214,9 +396,10 @@ std::string Memory::to_string(unsigned int bytes_per_line)
 		}
 
 		// Write the current byte -- prepend a 0 if necessary
-		if(memory[current_address] < 0x0F)	ss << "0";
+		unsigned char value = fetch(current_address);
+		if(value < 0x0F)	ss << "0";
 
-		ss << std::hex << (unsigned short) memory[current_address];
+		ss << std::hex << (unsigned short) value;
 
 		// Increment the address, then write a space or newline as appropriate
 		current_address++;
@@ -232,4 +415,164 @@ std::string Memory::to_string(unsigned int bytes_per_line)
 
 	// All done!
 	return ss.str();
-}
\ No newline at end of file
+}
+
+
+void Memory::mark_all_dirty()
+{
+	for(int i=0; i<MEMORY_LINES / 64; i++)
+	{
+		dirty_lines[i] = ~((uint64_t) 0);
+	}
+}
+
+
+void Memory::mark_dirty(unsigned short address, unsigned int size)
+{
+	for(unsigned int line = address / MEMORY_LINE_SIZE; line < (address + size + MEMORY_LINE_SIZE - 1) / MEMORY_LINE_SIZE; line++)
+	{
+		dirty_lines[line / 64] |= ((uint64_t) 1) << (line % 64);
+	}
+}
+
+
+bool Memory::has_dirty_lines()
+{
+	for(int i=0; i<MEMORY_LINES / 64; i++)
+	{
+		if(dirty_lines[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*******************
+* render_line(unsigned short line, char* text)
+*
+* Write the line of memory into the MEMORY_LINE_LENGTH characters of text, in
+* the same format as to_string(MEMORY_LINE_SIZE)
+*******************/
+void Memory::render_line(unsigned short line, char* text)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+
+	unsigned short address = line * MEMORY_LINE_SIZE;
+	const unsigned char* data = &pages[address / MEMORY_PAGE_SIZE]->data[address % MEMORY_PAGE_SIZE];
+
+	text[0] = '0';
+	text[1] = 'x';
+	text[2] = hex_digits[(address >> 12) & 0x0F];
+	text[3] = hex_digits[(address >> 8) & 0x0F];
+	text[4] = hex_digits[(address >> 4) & 0x0F];
+	text[5] = hex_digits[address & 0x0F];
+	text[6] = ':';
+
+	for(int i=0; i<MEMORY_LINE_SIZE; i++)
+	{
+		text[7 + 3*i] = ' ';
+		text[8 + 3*i] = hex_digits[data[i] >> 4];
+		text[9 + 3*i] = hex_digits[data[i] & 0x0F];
+	}
+
+	text[MEMORY_LINE_LENGTH - 1] = '\n';
+}
+
+
+/*******************
+* render_dirty_lines(char* text)
+*
+* Rewrite the lines of memory written since they were last rendered in the
+* text, which holds the whole of memory as MEMORY_LINES lines of
+* MEMORY_LINE_LENGTH characters, and mark them as clean.  Lines which haven't
+* changed are left as they are, so the same text should be passed every
+* time.  The text must have room for MEMORY_TEXT_LENGTH characters, plus a
+* terminating null, which is written after the last line.  Returns the
+* number of lines rendered.
+*
+* Only one view should render the lines of a memory, since rendering marks
+* them clean for every view.
+*******************/
+unsigned int Memory::render_dirty_lines(char* text)
+{
+	unsigned int num_rendered = 0;
+
+	for(int i=0; i<MEMORY_LINES / 64; i++)
+	{
+		// Most of memory is usually clean, so skip whole words of lines
+		if(!dirty_lines[i])
+		{
+			continue;
+		}
+
+		for(int bit=0; bit<64; bit++)
+		{
+			if(dirty_lines[i] & (((uint64_t) 1) << bit))
+			{
+				unsigned short line = i*64 + bit;
+				render_line(line, &text[line * MEMORY_LINE_LENGTH]);
+				num_rendered++;
+			}
+		}
+
+		dirty_lines[i] = 0;
+	}
+
+	text[MEMORY_TEXT_LENGTH] = '\0';
+
+	return num_rendered;
+}
+
+
+/*******************
+* save(Snapshot* snapshot)
+*
+* Write the contents of memory to the snapshot
+*******************/
+void Memory::save(Snapshot* snapshot)
+{
+	snapshot->begin_section(MEMORY_SECTION);
+	snapshot->write_short(memory_size);
+	for(int i=0; i<MEMORY_PAGES; i++)
+	{
+		snapshot->write_bytes(pages[i]->data, MEMORY_PAGE_SIZE);
+	}
+	snapshot->end_section();
+}
+
+
+/*******************
+* restore(Snapshot* snapshot)
+*
+* Replace the contents of memory with those in the snapshot, and inform the
+* listener.  Returns false if the snapshot doesn't hold memory of this size.
+*******************/
+bool Memory::restore(Snapshot* snapshot)
+{
+	if(!snapshot->open_section(MEMORY_SECTION) || snapshot->read_short() != memory_size)
+	{
+		return false;
+	}
+
+	for(int i=0; i<MEMORY_PAGES; i++)
+	{
+		snapshot->read_bytes(get_writable(i * MEMORY_PAGE_SIZE), MEMORY_PAGE_SIZE);
+	}
+
+	if(!snapshot->close_section())
+	{
+		return false;
+	}
+
+	mark_all_dirty();
+
+	if(listener)
+	{
+		listener->memory_restored();
+	}
+
+	return true;
+}
@@ -0,0 +1,180 @@
+#include "core/profiler.h"
+#include "disassembler/disassembler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+// A loop, from the target of a backward jump to the jump
+typedef struct ProfiledLoop_Struct {
+	unsigned short start;
+	unsigned short end;
+	unsigned long iterations;
+	unsigned long instructions;
+} ProfiledLoop;
+
+
+static bool more_instructions(const ProfiledLoop& a, const ProfiledLoop& b)
+{
+	return a.instructions > b.instructions;
+}
+
+
+Profiler::Profiler()
+{
+	clear();
+}
+
+
+void Profiler::clear()
+{
+	total = 0;
+
+	memset(address_counts, 0, sizeof(address_counts));
+	memset(opcodes, 0, sizeof(opcodes));
+	memset(opcode_counts, 0, sizeof(opcode_counts));
+	memset(backward_jumps, 0, sizeof(backward_jumps));
+	memset(jump_targets, 0, sizeof(jump_targets));
+}
+
+
+unsigned long Profiler::get_total()
+{
+	return total;
+}
+
+
+/************
+* get_count(unsigned short address)
+*
+* The number of times the instruction at the address was executed
+************/
+unsigned long Profiler::get_count(unsigned short address)
+{
+	return address_counts[address & (MEMORY_SIZE - 1)];
+}
+
+
+// Share of the total, as a percentage
+static double percent(unsigned long count, unsigned long total)
+{
+	return total > 0 ? 100.0 * count / total : 0.0;
+}
+
+
+// The disassembler separates operands with tabs, which don't line up in a
+// table
+static std::string untab(std::string text)
+{
+	std::replace(text.begin(), text.end(), '\t', ' ');
+	return text;
+}
+
+
+/************
+* report(std::ostream& out)
+*
+* Write the hottest instructions, with their disassembly, the number of
+* times each operation was executed, and the loops in which the most
+* instructions were executed, each sorted from the hottest
+************/
+void Profiler::report(std::ostream& out)
+{
+	Disassembler disassembler;
+	disassembler.create_operation_name_map();
+
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(1) << std::setfill(' ');
+
+	out << "Instructions executed: " << std::dec << total << std::endl;
+
+	// Hottest instructions
+	std::vector<std::pair<unsigned long, unsigned short> > hot;
+	for(unsigned int address=0; address<MEMORY_SIZE; address++)
+	{
+		if(address_counts[address] > 0)
+		{
+			hot.push_back(std::make_pair(address_counts[address], address));
+		}
+	}
+	std::sort(hot.begin(), hot.end(), std::greater<std::pair<unsigned long, unsigned short> >());
+
+	out << std::endl << "Hottest instructions:" << std::endl;
+	for(unsigned int i=0; i<hot.size() && i<PROFILE_HOT_INSTRUCTIONS; i++)
+	{
+		unsigned short address = hot[i].second;
+
+		out << "  0x" << std::hex << std::setw(3) << std::setfill('0') << address << std::setfill(' ');
+		out << std::dec << std::setw(14) << hot[i].first << std::setw(7) << percent(hot[i].first, total) << "%  ";
+		out << untab(disassembler.disassemble(address, opcodes[address])) << std::endl;
+	}
+
+	// Operations, gathered from the opcodes counted into the operation
+	// the disassembler decodes them as
+	std::map<unsigned short, unsigned long> operations;
+	for(unsigned int i=0; i<0x1000; i++)
+	{
+		if(opcode_counts[i] > 0)
+		{
+			unsigned short opcode = ((i & 0x0F00) << 4) | (i & 0x00FF);
+			operations[disassembler.get_opcode(opcode)] += opcode_counts[i];
+		}
+	}
+
+	std::vector<std::pair<unsigned long, unsigned short> > hot_operations;
+	for(std::map<unsigned short, unsigned long>::iterator it = operations.begin(); it != operations.end(); ++it)
+	{
+		hot_operations.push_back(std::make_pair(it->second, it->first));
+	}
+	std::sort(hot_operations.begin(), hot_operations.end(), std::greater<std::pair<unsigned long, unsigned short> >());
+
+	out << std::endl << "Operations:" << std::endl;
+	for(unsigned int i=0; i<hot_operations.size(); i++)
+	{
+		unsigned short operation = hot_operations[i].second;
+
+		out << "  0x" << std::hex << std::setw(4) << std::setfill('0') << operation << std::setfill(' ') << " ";
+		out << disassembler.get_mnemonic(operation);
+		out << std::dec << std::setw(12) << hot_operations[i].first << std::setw(7) << percent(hot_operations[i].first, total) << "%" << std::endl;
+	}
+
+	// Loops, as the instructions between the target of a backward jump and
+	// the jump.  Nested loops are each listed, so the shares can add up to
+	// more than the total.
+	std::vector<ProfiledLoop> loops;
+	for(unsigned int address=0; address<MEMORY_SIZE; address++)
+	{
+		if(backward_jumps[address] == 0)
+		{
+			continue;
+		}
+
+		ProfiledLoop loop;
+		loop.start = jump_targets[address];
+		loop.end = address;
+		loop.iterations = backward_jumps[address];
+		loop.instructions = 0;
+		for(unsigned int i=loop.start; i<=loop.end; i++)
+		{
+			loop.instructions += address_counts[i];
+		}
+
+		loops.push_back(loop);
+	}
+	std::sort(loops.begin(), loops.end(), more_instructions);
+
+	out << std::endl << "Loops:" << std::endl;
+	for(unsigned int i=0; i<loops.size() && i<PROFILE_LOOPS; i++)
+	{
+		out << "  0x" << std::hex << std::setw(3) << std::setfill('0') << loops[i].start;
+		out << "-0x" << std::setw(3) << loops[i].end << std::setfill(' ');
+		out << std::dec << std::setw(12) << loops[i].iterations << " iterations";
+		out << std::setw(14) << loops[i].instructions << " instructions" << std::setw(7) << percent(loops[i].instructions, total) << "%" << std::endl;
+	}
+
+	out.flags(flags);
+}
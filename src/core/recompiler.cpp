@@ -0,0 +1,611 @@
+#include "core/recompiler.h"
+
+#include <iostream>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// x86-64 register numbers
+#define RAX		0
+#define RCX		1
+#define RDX		2
+#define RBX		3
+#define RBP		5
+#define RSI		6
+#define RDI		7
+#define R8		8
+#define R9		9
+#define R10		10
+#define R11		11
+#define R12		12
+#define R13		13
+#define R14		14
+#define R15		15
+
+// Scratch registers used within an instruction
+#define TEMP0	RAX
+#define TEMP1	RDX
+
+// ALU opcodes (register, register form) and extensions (immediate form)
+#define ALU_ADD		0x01
+#define ALU_OR		0x09
+#define ALU_AND		0x21
+#define ALU_SUB		0x29
+#define ALU_XOR		0x31
+
+#define EXT_ADD		0
+#define EXT_AND		4
+#define EXT_XOR		6
+#define EXT_CMP		7
+
+#define EXT_SHL		4
+#define EXT_SHR		5
+
+// Largest block of code that a single compile may produce
+#define MAX_COMPILED_SIZE	0x1000
+
+// Index of the address register in host_registers
+#define ADDRESS_REGISTER	16
+#define NO_REGISTER			-1
+
+// Host registers available to hold CHIP-8 registers.  The callee-saved
+// registers are pushed and popped around each block.
+static const int register_pool[] = {RCX, RBX, RBP, R8, R9, R10, R11, R12, R13, R14, R15};
+static const int register_pool_size = 11;
+
+static const int saved_registers[] = {RBX, RBP, R12, R13, R14, R15};
+static const int num_saved_registers = 6;
+
+
+Recompiler::Recompiler()
+{
+	buffer = NULL;
+	buffer_used = 0;
+	page_size = 0x1000;
+
+#if defined(__x86_64__)
+	page_size = sysconf(_SC_PAGESIZE);
+
+	// The buffer starts out writable, and each block is made executable once
+	// it has been written
+	void* memory = mmap(NULL, RECOMPILER_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if(memory == MAP_FAILED)
+	{
+		std::cout << "RECOMPILER ERROR: Could not allocate memory for compiled code" << std::endl;
+	}
+	else
+	{
+		buffer = (unsigned char*) memory;
+	}
+#endif
+}
+
+
+Recompiler::~Recompiler()
+{
+#if defined(__x86_64__)
+	if(buffer)
+	{
+		munmap(buffer, RECOMPILER_BUFFER_SIZE);
+	}
+#endif
+}
+
+
+bool Recompiler::is_available()
+{
+	return buffer != NULL;
+}
+
+
+/*******************
+* protect(unsigned int start, unsigned int end, bool executable)
+*
+* Make the pages of the buffer holding the bytes from start to end either
+* executable or writable, never both.  Returns false if the protection
+* couldn't be changed.
+*******************/
+bool Recompiler::protect(unsigned int start, unsigned int end, bool executable)
+{
+#if defined(__x86_64__)
+	start &= ~(page_size - 1);
+	end = (end + page_size - 1) & ~(page_size - 1);
+	if(end > RECOMPILER_BUFFER_SIZE)
+	{
+		end = RECOMPILER_BUFFER_SIZE;
+	}
+
+	int protection = executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE;
+
+	return mprotect(buffer + start, end - start, protection) == 0;
+#else
+	return false;
+#endif
+}
+
+
+/*******************
+* reset()
+*
+* Discard all compiled blocks.  Any previously returned block must no longer
+* be called.
+*******************/
+void Recompiler::reset()
+{
+	buffer_used = 0;
+}
+
+
+/*******************
+* bool can_compile(unsigned short opcode)
+*
+* Check if the opcode is one of the register and arithmetic instructions
+* that can be compiled:  6xkk, 7xkk, 8xy0-8xy7, 8xyE, Annn and Fx1E.
+*******************/
+bool Recompiler::can_compile(unsigned short opcode)
+{
+	switch(opcode & 0xF000)
+	{
+		case 0x6000:
+		case 0x7000:
+		case 0xA000:
+			return true;
+
+		case 0x8000:
+			return (opcode & 0x000F) <= 0x0007 || (opcode & 0x000F) == 0x000E;
+
+		case 0xF000:
+			return (opcode & 0x00FF) == 0x001E;
+
+		default:
+			return false;
+	}
+}
+
+
+/*******************
+* unsigned int get_written_registers(unsigned short opcode)
+*
+* Return a mask of the registers written by a compilable opcode.  Bits 0-15
+* are V0 - VF, and bit 16 is the address register.
+*******************/
+unsigned int Recompiler::get_written_registers(unsigned short opcode)
+{
+	unsigned int register_x = 1 << ((opcode & 0x0F00) >> 8);
+
+	switch(opcode & 0xF000)
+	{
+		case 0x6000:
+		case 0x7000:
+			return register_x;
+
+		case 0xA000:
+			return 1 << ADDRESS_REGISTER;
+
+		case 0x8000:
+			// Logical operations and assignment leave VF alone
+			if((opcode & 0x000F) <= 0x0003)
+			{
+				return register_x;
+			}
+			return register_x | (1 << 0x0F);
+
+		case 0xF000:
+			return (1 << ADDRESS_REGISTER) | (1 << 0x0F);
+
+		default:
+			return 0;
+	}
+}
+
+
+/*******************
+* int allocate_registers(const unsigned short* opcodes, unsigned int count)
+*
+* Assign a host register to each CHIP-8 register used by the opcodes, stopping
+* when the opcodes can't be compiled or the host registers run out.  Returns
+* the number of opcodes that can be compiled.
+*******************/
+int Recompiler::allocate_registers(const unsigned short* opcodes, unsigned int count)
+{
+	int num_allocated = 0;
+
+	for(int i=0; i<17; i++)
+	{
+		host_registers[i] = NO_REGISTER;
+	}
+
+	for(unsigned int i=0; i<count; i++)
+	{
+		unsigned short opcode = opcodes[i];
+
+		if(!can_compile(opcode))
+		{
+			return i;
+		}
+
+		// Registers read or written by this instruction
+		unsigned int used = get_written_registers(opcode);
+		if((opcode & 0xF000) == 0x8000)
+		{
+			used |= 1 << ((opcode & 0x00F0) >> 4);
+		}
+		if((opcode & 0xF0FF) == 0xF01E)
+		{
+			used |= 1 << ((opcode & 0x0F00) >> 8);
+		}
+
+		// How many new host registers are needed?
+		int needed = 0;
+		for(int reg=0; reg<17; reg++)
+		{
+			if((used & (1 << reg)) && host_registers[reg] == NO_REGISTER)
+			{
+				needed++;
+			}
+		}
+
+		if(num_allocated + needed > register_pool_size)
+		{
+			return i;
+		}
+
+		for(int reg=0; reg<17; reg++)
+		{
+			if((used & (1 << reg)) && host_registers[reg] == NO_REGISTER)
+			{
+				host_registers[reg] = register_pool[num_allocated];
+				num_allocated++;
+			}
+		}
+	}
+
+	return count;
+}
+
+
+/*******************
+* unsigned int compile(const unsigned short* opcodes, unsigned int count, CompiledBlock* block)
+*
+* Compile as many of the opcodes as possible into a single block.  Returns the
+* number of opcodes compiled, or 0 if none could be compiled (including when
+* the buffer is full).
+*******************/
+unsigned int Recompiler::compile(const unsigned short* opcodes, unsigned int count, CompiledBlock* block)
+{
+	if(!buffer || buffer_used + MAX_COMPILED_SIZE > RECOMPILER_BUFFER_SIZE)
+	{
+		return 0;
+	}
+
+	int num_compiled = allocate_registers(opcodes, count);
+
+	if(num_compiled == 0)
+	{
+		return 0;
+	}
+
+	unsigned int written = 0;
+	for(int i=0; i<num_compiled; i++)
+	{
+		written |= get_written_registers(opcodes[i]);
+	}
+
+	// The page holding the end of the last block is executable, so make the
+	// pages this block may be written to writable again
+	if(!protect(buffer_used, buffer_used + MAX_COMPILED_SIZE, false))
+	{
+		return 0;
+	}
+
+	code = buffer + buffer_used;
+	*block = (CompiledBlock) code;
+
+	// Prologue -- save the callee-saved registers, and load the CHIP-8
+	// registers used by the block
+	for(int i=0; i<num_saved_registers; i++)
+	{
+		if(saved_registers[i] >= R8)	emit(0x41);
+		emit(0x50 + (saved_registers[i] & 0x07));
+	}
+
+	for(int reg=0; reg<16; reg++)
+	{
+		if(host_registers[reg] != NO_REGISTER)
+		{
+			emit_load_register(host_registers[reg], reg);
+		}
+	}
+	if(host_registers[ADDRESS_REGISTER] != NO_REGISTER)
+	{
+		emit_load_address(host_registers[ADDRESS_REGISTER]);
+	}
+
+	// Body
+	for(int i=0; i<num_compiled; i++)
+	{
+		emit_instruction(opcodes[i]);
+	}
+
+	// Epilogue -- write back the modified registers, and restore the
+	// callee-saved registers
+	for(int reg=0; reg<16; reg++)
+	{
+		if(written & (1 << reg))
+		{
+			emit_store_register(host_registers[reg], reg);
+		}
+	}
+	if(written & (1 << ADDRESS_REGISTER))
+	{
+		emit_store_address(host_registers[ADDRESS_REGISTER]);
+	}
+
+	for(int i=num_saved_registers-1; i>=0; i--)
+	{
+		if(saved_registers[i] >= R8)	emit(0x41);
+		emit(0x58 + (saved_registers[i] & 0x07));
+	}
+	emit(0xC3);
+
+	unsigned int start = buffer_used;
+	buffer_used = code - buffer;
+
+	if(!protect(start, buffer_used, true))
+	{
+		std::cout << "RECOMPILER ERROR: Could not make compiled code executable" << std::endl;
+		buffer_used = start;
+		return 0;
+	}
+
+	return num_compiled;
+}
+
+
+/*******************
+* emit_instruction(unsigned short opcode)
+*
+* Emit the machine code for a single opcode.  Each sequence performs the
+* same steps, in the same order, as the corresponding Chip8 operation, so
+* that the results match when Vx, Vy and VF overlap.  CHIP-8 registers are
+* kept zero-extended in 32-bit host registers.
+*******************/
+void Recompiler::emit_instruction(unsigned short opcode)
+{
+	int vx = host_registers[(opcode & 0x0F00) >> 8];
+	int vy = host_registers[(opcode & 0x00F0) >> 4];
+	int vf = host_registers[0x0F];
+	int address_register = host_registers[ADDRESS_REGISTER];
+	unsigned char value = opcode & 0x00FF;
+
+	switch(opcode & 0xF000)
+	{
+		case 0x6000:		// Vx = kk
+			emit_mov_immediate(vx, value);
+			break;
+
+		case 0x7000:		// Vx += kk
+			emit_alu_immediate(EXT_ADD, vx, value);
+			emit_alu_immediate(EXT_AND, vx, 0xFF);
+			break;
+
+		case 0xA000:		// I = nnn
+			emit_mov_immediate(address_register, opcode & 0x0FFF);
+			break;
+
+		case 0xF000:		// I += Vx, VF = 1 if I passes 0x0FFF
+			emit_alu(ALU_ADD, address_register, vx);
+			emit_alu_immediate(EXT_AND, address_register, 0xFFFF);
+			emit_alu_immediate(EXT_CMP, address_register, 0x0FFF);
+			emit(0x76);					// jbe past the assignment
+			emit(vf >= R8 ? 6 : 5);
+			emit_mov_immediate(vf, 0x01);
+			break;
+
+		case 0x8000:
+			switch(opcode & 0x000F)
+			{
+				case 0x0000:		// Vx = Vy
+					emit_mov(vx, vy);
+					break;
+
+				case 0x0001:		// Vx |= Vy
+					emit_alu(ALU_OR, vx, vy);
+					break;
+
+				case 0x0002:		// Vx &= Vy
+					emit_alu(ALU_AND, vx, vy);
+					break;
+
+				case 0x0003:		// Vx ^= Vy
+					emit_alu(ALU_XOR, vx, vy);
+					break;
+
+				case 0x0004:		// Vx += Vy, VF = carry
+					emit_mov(TEMP0, vx);
+					emit_alu(ALU_ADD, TEMP0, vy);
+					emit_mov(vf, TEMP0);
+					emit_shift(EXT_SHR, vf, 8);
+					emit_mov(vx, TEMP0);
+					emit_alu_immediate(EXT_AND, vx, 0xFF);
+					break;
+
+				case 0x0005:		// Vx -= Vy, VF = not borrow
+					emit_mov(TEMP0, vx);
+					emit_mov(TEMP1, vx);
+					emit_alu(ALU_SUB, TEMP1, vy);
+					emit_shift(EXT_SHR, TEMP1, 31);
+					emit_alu_immediate(EXT_XOR, TEMP1, 0x01);
+					emit_mov(vf, TEMP1);
+					emit_alu_immediate(EXT_ADD, TEMP0, 0x0100);
+					emit_alu(ALU_SUB, TEMP0, vy);
+					emit_alu_immediate(EXT_AND, TEMP0, 0xFF);
+					emit_mov(vx, TEMP0);
+					break;
+
+				case 0x0007:		// Vx = Vy - Vx, VF = not borrow
+					emit_mov(TEMP0, vy);
+					emit_mov(TEMP1, vy);
+					emit_alu(ALU_SUB, TEMP1, vx);
+					emit_shift(EXT_SHR, TEMP1, 31);
+					emit_alu_immediate(EXT_XOR, TEMP1, 0x01);
+					emit_mov(vf, TEMP1);
+					emit_alu_immediate(EXT_ADD, TEMP0, 0x0100);
+					emit_alu(ALU_SUB, TEMP0, vx);
+					emit_alu_immediate(EXT_AND, TEMP0, 0xFF);
+					emit_mov(vx, TEMP0);
+					break;
+
+				case 0x0006:		// VF = LSB, Vx >>= 1
+					emit_mov(vf, vx);
+					emit_alu_immediate(EXT_AND, vf, 0x01);
+					emit_shift(EXT_SHR, vx, 1);
+					break;
+
+				case 0x000E:		// VF = MSB, Vx <<= 1
+					emit_mov(TEMP1, vx);
+					emit_shift(EXT_SHR, TEMP1, 7);
+					emit_mov(vf, TEMP1);
+					emit_shift(EXT_SHL, vx, 1);
+					emit_alu_immediate(EXT_AND, vx, 0xFE);
+					break;
+			}
+			break;
+	}
+}
+
+
+/**********************
+* Instruction encoding
+**********************/
+
+void Recompiler::emit(unsigned char byte)
+{
+	*code = byte;
+	code++;
+}
+
+
+void Recompiler::emit_word(unsigned int word)
+{
+	emit(word & 0xFF);
+	emit((word >> 8) & 0xFF);
+	emit((word >> 16) & 0xFF);
+	emit((word >> 24) & 0xFF);
+}
+
+
+/*******************
+* emit_rex(bool force, int reg, int rm)
+*
+* Emit a REX prefix if either register number needs the extension bits, or if
+* one is forced (to address the low byte of SPL, BPL, SIL and DIL).
+*******************/
+void Recompiler::emit_rex(bool force, int reg, int rm)
+{
+	unsigned char rex = 0x40;
+
+	if(reg >= R8)	rex |= 0x04;
+	if(rm >= R8)	rex |= 0x01;
+
+	if(force || rex != 0x40)
+	{
+		emit(rex);
+	}
+}
+
+
+// mov dst, src  (32-bit)
+void Recompiler::emit_mov(int dst, int src)
+{
+	if(dst == src)
+	{
+		return;
+	}
+
+	emit_rex(false, src, dst);
+	emit(0x89);
+	emit(0xC0 | ((src & 0x07) << 3) | (dst & 0x07));
+}
+
+
+// op dst, src  (32-bit)
+void Recompiler::emit_alu(unsigned char opcode, int dst, int src)
+{
+	emit_rex(false, src, dst);
+	emit(opcode);
+	emit(0xC0 | ((src & 0x07) << 3) | (dst & 0x07));
+}
+
+
+// op dst, imm32
+void Recompiler::emit_alu_immediate(unsigned char extension, int dst, unsigned int value)
+{
+	emit_rex(false, 0, dst);
+	emit(0x81);
+	emit(0xC0 | (extension << 3) | (dst & 0x07));
+	emit_word(value);
+}
+
+
+// mov dst, imm32
+void Recompiler::emit_mov_immediate(int dst, unsigned int value)
+{
+	emit_rex(false, 0, dst);
+	emit(0xB8 + (dst & 0x07));
+	emit_word(value);
+}
+
+
+// shl / shr dst, imm8
+void Recompiler::emit_shift(unsigned char extension, int dst, unsigned char amount)
+{
+	emit_rex(false, 0, dst);
+	emit(0xC1);
+	emit(0xC0 | (extension << 3) | (dst & 0x07));
+	emit(amount);
+}
+
+
+// movzx dst, byte [rdi + register_number]
+void Recompiler::emit_load_register(int dst, unsigned char register_number)
+{
+	emit_rex(false, dst, RDI);
+	emit(0x0F);
+	emit(0xB6);
+	emit(0x40 | ((dst & 0x07) << 3) | RDI);
+	emit(register_number);
+}
+
+
+// mov byte [rdi + register_number], src
+void Recompiler::emit_store_register(int src, unsigned char register_number)
+{
+	emit_rex(true, src, RDI);
+	emit(0x88);
+	emit(0x40 | ((src & 0x07) << 3) | RDI);
+	emit(register_number);
+}
+
+
+// movzx dst, word [rsi]
+void Recompiler::emit_load_address(int dst)
+{
+	emit_rex(false, dst, RSI);
+	emit(0x0F);
+	emit(0xB7);
+	emit(((dst & 0x07) << 3) | RSI);
+}
+
+
+// mov word [rsi], src
+void Recompiler::emit_store_address(int src)
+{
+	emit(0x66);
+	emit_rex(false, src, RSI);
+	emit(0x89);
+	emit(((src & 0x07) << 3) | RSI);
+}
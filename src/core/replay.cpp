@@ -0,0 +1,365 @@
+#include "core/replay.h"
+#include "core/computer.h"
+
+#include <iostream>
+#include <fstream>
+
+// Values are stored in files little endian, as in snapshots
+static void write_value(std::ofstream& file, uint64_t value, int num_bytes)
+{
+	for(int i=0; i<num_bytes; i++)
+	{
+		file.put((char) ((value >> (8*i)) & 0xFF));
+	}
+}
+
+
+static uint64_t read_value(std::ifstream& file, int num_bytes)
+{
+	uint64_t value = 0;
+	for(int i=0; i<num_bytes; i++)
+	{
+		value |= ((uint64_t) (unsigned char) file.get()) << (8*i);
+	}
+
+	return value;
+}
+
+
+Replay::Replay()
+{
+	computer = NULL;
+	mode = REPLAY_STOPPED;
+
+	seed = 0;
+	instructions_per_frame = 0;
+	start_keys = 0;
+
+	start_hash = 0;
+	end_hash = 0;
+
+	num_frames = 0;
+
+	frame = 0;
+	run = 0;
+	run_frame = 0;
+}
+
+
+/************
+* record(Computer* computer)
+*
+* Start a new recording of the computer from its current state.  The random
+* number generator is reseeded with the chip's seed, so the recording starts
+* from a known point in its sequence.  The replay should be added as the
+* listener of the computer's clock.
+************/
+void Replay::record(Computer* _computer)
+{
+	computer = _computer;
+
+	runs.clear();
+	num_frames = 0;
+
+	seed = computer->get_chip()->get_seed();
+	computer->get_chip()->set_seed(seed);
+	instructions_per_frame = computer->get_clock()->get_instructions_per_frame();
+
+	Keyboard* keyboard = computer->get_keyboard();
+	keyboard->set_latched(true);
+	start_keys = keyboard->get_key_mask();
+
+	start_hash = hash_state();
+	end_hash = 0;
+
+	mode = REPLAY_RECORDING;
+}
+
+
+/************
+* play(Computer* computer)
+*
+* Start playing the replay on the computer, which should have been reset and
+* loaded with the same program as when it was recorded.  Returns false if the
+* computer isn't in the state the recording started from.  The replay should
+* be added as the listener of the computer's clock.
+************/
+bool Replay::play(Computer* _computer)
+{
+	computer = _computer;
+
+	computer->get_chip()->set_seed(seed);
+	computer->get_clock()->set_instructions_per_frame(instructions_per_frame);
+
+	Keyboard* keyboard = computer->get_keyboard();
+	keyboard->set_latched(true);
+	keyboard->set_key_mask(start_keys);
+
+	frame = 0;
+	run = 0;
+	run_frame = 0;
+
+	mode = REPLAY_PLAYING;
+
+	return hash_state() == start_hash;
+}
+
+
+/************
+* stop()
+*
+* Stop recording or playing.  A recording keeps the state of the computer it
+* finished in, for playback to be checked against.
+************/
+void Replay::stop()
+{
+	if(mode == REPLAY_STOPPED)
+	{
+		return;
+	}
+
+	if(mode == REPLAY_RECORDING)
+	{
+		end_hash = hash_state();
+	}
+
+	computer->get_keyboard()->set_latched(false);
+	mode = REPLAY_STOPPED;
+}
+
+
+/************
+* is_finished()
+*
+* Whether every recorded frame has been played
+************/
+bool Replay::is_finished()
+{
+	return frame >= num_frames;
+}
+
+
+/************
+* check()
+*
+* Whether the computer is in the state the recording finished in
+************/
+bool Replay::check()
+{
+	return computer && hash_state() == end_hash;
+}
+
+
+uint64_t Replay::hash_state()
+{
+	Snapshot snapshot;
+	computer->save(&snapshot);
+
+	return snapshot.get_hash();
+}
+
+
+/************
+* frame_starting()
+*
+* Record the keys pressed for the frame, or press the recorded ones
+************/
+void Replay::frame_starting()
+{
+	Keyboard* keyboard;
+
+	switch(mode)
+	{
+		case REPLAY_RECORDING:
+			keyboard = computer->get_keyboard();
+			keyboard->latch();
+
+			if(!runs.empty() && runs.back().keys == keyboard->get_key_mask())
+			{
+				runs.back().frames++;
+			}
+			else
+			{
+				ReplayRun new_run = {keyboard->get_key_mask(), 1};
+				runs.push_back(new_run);
+			}
+			num_frames++;
+			break;
+
+		case REPLAY_PLAYING:
+			if(frame >= num_frames)
+			{
+				break;
+			}
+
+			computer->get_keyboard()->set_key_mask(runs[run].keys);
+
+			frame++;
+			run_frame++;
+			if(run_frame == runs[run].frames)
+			{
+				run++;
+				run_frame = 0;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+/************
+* frame_rewound()
+*
+* Forget the last frame recorded, or step playback back a frame
+************/
+void Replay::frame_rewound()
+{
+	switch(mode)
+	{
+		case REPLAY_RECORDING:
+			if(num_frames == 0)
+			{
+				break;
+			}
+
+			num_frames--;
+			runs.back().frames--;
+			if(runs.back().frames == 0)
+			{
+				runs.pop_back();
+			}
+			break;
+
+		case REPLAY_PLAYING:
+			if(frame == 0)
+			{
+				break;
+			}
+
+			frame--;
+			if(run_frame == 0)
+			{
+				run--;
+				run_frame = runs[run].frames;
+			}
+			run_frame--;
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+/************
+* save(const char* filename)
+*
+* Write the replay to a file.  Returns false if it couldn't be written.
+************/
+bool Replay::save(const char* filename)
+{
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+	if(!file.is_open())
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	write_value(file, REPLAY_MAGIC, 4);
+	write_value(file, REPLAY_VERSION, 1);
+
+	write_value(file, seed, 4);
+	write_value(file, instructions_per_frame, 4);
+	write_value(file, start_keys, 2);
+	write_value(file, start_hash, 8);
+	write_value(file, end_hash, 8);
+
+	write_value(file, runs.size(), 4);
+	for(unsigned int i=0; i<runs.size(); i++)
+	{
+		write_value(file, runs[i].keys, 2);
+		write_value(file, runs[i].frames, 4);
+	}
+
+	return file.good();
+}
+
+
+/************
+* load(const char* filename)
+*
+* Read a replay from a file.  Returns false if it couldn't be read, or isn't
+* a replay of this version.
+************/
+bool Replay::load(const char* filename)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+	if(!file.is_open())
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	if(read_value(file, 4) != REPLAY_MAGIC || read_value(file, 1) != REPLAY_VERSION)
+	{
+		std::cout << "ERROR: File " << filename << " is not a replay!" << std::endl;
+		return false;
+	}
+
+	seed = read_value(file, 4);
+	instructions_per_frame = read_value(file, 4);
+	start_keys = read_value(file, 2);
+	start_hash = read_value(file, 8);
+	end_hash = read_value(file, 8);
+
+	unsigned int num_runs = read_value(file, 4);
+
+	runs.clear();
+	num_frames = 0;
+	for(unsigned int i=0; i<num_runs && file.good(); i++)
+	{
+		ReplayRun new_run;
+		new_run.keys = read_value(file, 2);
+		new_run.frames = read_value(file, 4);
+
+		if(new_run.frames > 0)
+		{
+			runs.push_back(new_run);
+			num_frames += new_run.frames;
+		}
+	}
+
+	if(!file.good())
+	{
+		std::cout << "ERROR: Replay " << filename << " is truncated!" << std::endl;
+		runs.clear();
+		num_frames = 0;
+		return false;
+	}
+
+	mode = REPLAY_STOPPED;
+
+	return true;
+}
+
+
+unsigned int Replay::get_seed()
+{
+	return seed;
+}
+
+
+unsigned int Replay::get_instructions_per_frame()
+{
+	return instructions_per_frame;
+}
+
+
+unsigned int Replay::get_num_frames()
+{
+	return num_frames;
+}
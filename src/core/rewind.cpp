@@ -0,0 +1,341 @@
+#include "core/rewind.h"
+#include "core/computer.h"
+
+#include <string.h>
+
+/************
+*
+* Create a history of the default length
+************/
+Rewind::Rewind(Computer* _computer)
+{
+	computer = _computer;
+
+	capacity = REWIND_CAPACITY;
+	history = new unsigned char[capacity];
+
+	max_frames = REWIND_FRAMES;
+
+	clear();
+}
+
+
+/************
+*
+* Create a history of the given number of frames
+************/
+Rewind::Rewind(Computer* _computer, unsigned int _max_frames)
+{
+	computer = _computer;
+
+	capacity = REWIND_CAPACITY;
+	history = new unsigned char[capacity];
+
+	max_frames = _max_frames > 0 ? _max_frames : 1;
+
+	clear();
+}
+
+
+Rewind::~Rewind()
+{
+	delete [] history;
+}
+
+
+/************
+* clear()
+*
+* Forget the whole history.  The next frame recorded is the oldest which can
+* be stepped back to.
+************/
+void Rewind::clear()
+{
+	head = 0;
+	used = 0;
+	num_frames = 0;
+
+	state_size = 0;
+	memset(state, 0, SNAPSHOT_CAPACITY);
+}
+
+
+/************
+* record()
+*
+* Snapshot the computer, and add the frame to the history, dropping the
+* oldest frames if there isn't room.  Should be called after every frame.
+************/
+void Rewind::record()
+{
+	if(!computer->save(&snapshot))
+	{
+		clear();
+		return;
+	}
+
+	const unsigned char* data = snapshot.get_data();
+	unsigned int size = snapshot.get_size();
+
+	// The first frame is only kept as the newest snapshot
+	if(state_size == 0)
+	{
+		memcpy(state, data, size);
+		state_size = size;
+		return;
+	}
+
+	unsigned int length = encode_delta(data, size);
+	unsigned int record_size = length + REWIND_RECORD_OVERHEAD;
+
+	if(record_size > capacity)
+	{
+		clear();
+		memcpy(state, data, size);
+		state_size = size;
+		return;
+	}
+
+	while(used + record_size > capacity || num_frames >= max_frames)
+	{
+		drop_oldest();
+	}
+
+	unsigned char header[4] = {(unsigned char) (length & 0xFF), (unsigned char) (length >> 8),
+	                           (unsigned char) (state_size & 0xFF), (unsigned char) (state_size >> 8)};
+	unsigned int tail = (head + used) % capacity;
+
+	write_history(tail, header, 4);
+	write_history((tail + 4) % capacity, delta, length);
+	write_history((tail + 4 + length) % capacity, header, 2);
+
+	used += record_size;
+	num_frames++;
+
+	// The new snapshot becomes the newest, with the bytes past its end zeroed
+	// in case it is shorter than the last one
+	unsigned int old_size = state_size;
+	memcpy(state, data, size);
+	if(old_size > size)
+	{
+		memset(&state[size], 0, old_size - size);
+	}
+	state_size = size;
+}
+
+
+/************
+* step_back()
+*
+* Restore the computer to the frame before the newest in the history, and
+* drop the newest frame.  Returns false if there's no earlier frame, or it
+* couldn't be restored.
+************/
+bool Rewind::step_back()
+{
+	if(num_frames == 0)
+	{
+		return false;
+	}
+
+	unsigned int tail = (head + used) % capacity;
+	unsigned int length = read_history_short((tail + capacity - 2) % capacity);
+	unsigned int start = (tail + capacity - length - REWIND_RECORD_OVERHEAD) % capacity;
+
+	unsigned int previous_size = read_history_short((start + 2) % capacity);
+	read_history((start + 4) % capacity, delta, length);
+
+	apply_delta(length, previous_size);
+
+	used -= length + REWIND_RECORD_OVERHEAD;
+	num_frames--;
+
+	snapshot.set_data(state, state_size);
+
+	return computer->restore(&snapshot);
+}
+
+
+/************
+* encode_delta(const unsigned char* data, unsigned int size)
+*
+* Encode the difference between the newest snapshot and the given one into
+* the delta buffer, and return its length.  The bytes of the snapshots are
+* XORed, and the result is written as a sequence of runs:  the number of zero
+* bytes to skip, the number of bytes which follow, and those bytes.  Counts
+* are written seven bits at a time, least significant first, with the top bit
+* set if more follow.  A trailing run of zeros is left out.
+************/
+unsigned int Rewind::encode_delta(const unsigned char* data, unsigned int size)
+{
+	// XOR the new snapshot into the newest in place.  Bytes past the end of
+	// either snapshot are zero.
+	for(unsigned int i=0; i<size; i++)
+	{
+		state[i] ^= data[i];
+	}
+
+	unsigned int end = size > state_size ? size : state_size;
+	unsigned int length = 0;
+	unsigned int i = 0;
+
+	while(i < end)
+	{
+		unsigned int zeros_start = i;
+
+		// Skip unchanged bytes a word at a time where possible
+		while(i + 8 <= end)
+		{
+			uint64_t word;
+			memcpy(&word, &state[i], 8);
+			if(word != 0)
+			{
+				break;
+			}
+			i += 8;
+		}
+		while(i < end && state[i] == 0)
+		{
+			i++;
+		}
+
+		if(i == end)
+		{
+			break;
+		}
+
+		// Bytes run until the next pair of unchanged bytes, since a single
+		// zero costs less to copy than to start a new run
+		unsigned int bytes_start = i;
+		while(i < end && (state[i] != 0 || (i + 1 < end && state[i+1] != 0)))
+		{
+			i++;
+		}
+
+		unsigned int counts[2] = {bytes_start - zeros_start, i - bytes_start};
+		for(int c=0; c<2; c++)
+		{
+			unsigned int count = counts[c];
+			while(count >= 0x80)
+			{
+				delta[length++] = (count & 0x7F) | 0x80;
+				count >>= 7;
+			}
+			delta[length++] = count;
+		}
+
+		memcpy(&delta[length], &state[bytes_start], i - bytes_start);
+		length += i - bytes_start;
+	}
+
+	return length;
+}
+
+
+/************
+* apply_delta(unsigned int length, unsigned int previous_size)
+*
+* XOR the encoded delta in the delta buffer into the newest snapshot, which
+* turns it back into the snapshot before it
+************/
+void Rewind::apply_delta(unsigned int length, unsigned int previous_size)
+{
+	unsigned int position = 0;
+	unsigned int address = 0;
+
+	while(position < length)
+	{
+		unsigned int counts[2] = {0, 0};
+		for(int c=0; c<2; c++)
+		{
+			unsigned int shift = 0;
+			unsigned char byte;
+			do
+			{
+				byte = delta[position++];
+				counts[c] |= (byte & 0x7F) << shift;
+				shift += 7;
+			} while((byte & 0x80) && position < length);
+		}
+
+		address += counts[0];
+
+		// A corrupt delta mustn't write outside the snapshot
+		if(address + counts[1] > SNAPSHOT_CAPACITY || position + counts[1] > length)
+		{
+			break;
+		}
+
+		for(unsigned int i=0; i<counts[1]; i++)
+		{
+			state[address + i] ^= delta[position + i];
+		}
+
+		address += counts[1];
+		position += counts[1];
+	}
+
+	state_size = previous_size;
+}
+
+
+void Rewind::write_history(unsigned int position, const unsigned char* data, unsigned int length)
+{
+	unsigned int first = capacity - position < length ? capacity - position : length;
+
+	memcpy(&history[position], data, first);
+	memcpy(history, &data[first], length - first);
+}
+
+
+void Rewind::read_history(unsigned int position, unsigned char* data, unsigned int length)
+{
+	unsigned int first = capacity - position < length ? capacity - position : length;
+
+	memcpy(data, &history[position], first);
+	memcpy(&data[first], history, length - first);
+}
+
+
+unsigned short Rewind::read_history_short(unsigned int position)
+{
+	return history[position] | (history[(position + 1) % capacity] << 8);
+}
+
+
+/************
+* drop_oldest()
+*
+* Remove the oldest frame from the history, to make room for a new one
+************/
+void Rewind::drop_oldest()
+{
+	unsigned int length = read_history_short(head);
+
+	head = (head + length + REWIND_RECORD_OVERHEAD) % capacity;
+	used -= length + REWIND_RECORD_OVERHEAD;
+	num_frames--;
+}
+
+
+unsigned int Rewind::get_num_frames()
+{
+	return num_frames;
+}
+
+
+unsigned int Rewind::get_max_frames()
+{
+	return max_frames;
+}
+
+
+/************
+* get_size()
+*
+* The number of bytes of history in use
+************/
+unsigned int Rewind::get_size()
+{
+	return used;
+}
@@ -0,0 +1,526 @@
+#include "core/rom_catalog.h"
+#include "core/clock.h"
+#include "core/rom_image.h"
+#include "disassembler/disassembler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+// Where programs are loaded
+#define PROGRAM_START			0x200
+
+typedef struct RomVariantInfo_Struct {
+	const char* name;
+	unsigned int instructions_per_frame;
+} RomVariantInfo;
+
+// SCHIP programs were written for the faster HP-48, and MegaChip programs
+// for emulators running a thousand or so instructions a frame
+static const RomVariantInfo ROM_VARIANTS[NUM_ROM_VARIANTS] = {
+	{"chip8", DEFAULT_INSTRUCTIONS_PER_FRAME},
+	{"schip", 30},
+	{"chip8x", DEFAULT_INSTRUCTIONS_PER_FRAME},
+	{"megachip", 1000}
+};
+
+
+static void write_value(std::string& buffer, uint64_t value, int num_bytes)
+{
+	for(int i=0; i<num_bytes; i++)
+	{
+		buffer.push_back((char) ((value >> (8*i)) & 0xFF));
+	}
+}
+
+
+static void write_string(std::string& buffer, const std::string& text)
+{
+	write_value(buffer, text.size(), 4);
+	buffer.append(text);
+}
+
+
+/************
+* read_value(data, position, num_bytes)
+*
+* Read a value from the index at the position, and move past it.  Reading
+* past the end of the index moves the position past the end, and returns 0.
+************/
+static uint64_t read_value(const std::vector<char>& data, size_t& position, int num_bytes)
+{
+	if(position + num_bytes > data.size())
+	{
+		position = data.size() + 1;
+		return 0;
+	}
+
+	uint64_t value = 0;
+	for(int i=0; i<num_bytes; i++)
+	{
+		value |= ((uint64_t) (unsigned char) data[position + i]) << (8*i);
+	}
+	position += num_bytes;
+
+	return value;
+}
+
+
+static const char* read_bytes(const std::vector<char>& data, size_t& position, size_t* num_bytes)
+{
+	*num_bytes = read_value(data, position, 4);
+
+	if(position > data.size() || *num_bytes > data.size() - position)
+	{
+		static const char nothing = 0;
+
+		position = data.size() + 1;
+		*num_bytes = 0;
+		return &nothing;
+	}
+
+	const char* bytes = data.data() + position;
+	position += *num_bytes;
+
+	return bytes;
+}
+
+
+RomCatalog::RomCatalog()
+{
+	rom_database = NULL;
+	changed = false;
+}
+
+
+RomCatalog::~RomCatalog()
+{
+	clear();
+}
+
+
+void RomCatalog::clear()
+{
+	for(unsigned int i=0; i<entries.size(); i++)
+	{
+		delete entries[i];
+	}
+
+	entries.clear();
+	by_filename.clear();
+	by_hash.clear();
+}
+
+
+/************
+* set_rom_database(RomDatabase* database)
+*
+* Take the quirk profile of each ROM from the database.  ROMs not in the
+* database use the default quirks.
+************/
+void RomCatalog::set_rom_database(RomDatabase* database)
+{
+	rom_database = database;
+}
+
+
+void RomCatalog::insert(CatalogEntry* entry)
+{
+	entries.push_back(entry);
+	by_filename[entry->filename] = entry;
+	by_hash[entry->hash] = entry;
+}
+
+
+/************
+* describe(CatalogEntry* entry)
+*
+* Work out everything about the ROM from its data
+************/
+void RomCatalog::describe(CatalogEntry* entry)
+{
+	const unsigned char* data = entry->data.data();
+	unsigned int size = entry->data.size();
+
+	entry->hash = RomDatabase::hash(data, size);
+	entry->variant = detect_variant(entry->filename, data, size);
+	entry->instructions_per_frame = get_instructions_per_frame(entry->variant);
+
+	entry->quirks = DEFAULT_QUIRKS;
+	if(rom_database)
+	{
+		rom_database->find(entry->hash, &entry->quirks);
+	}
+
+	entry->disassembly = disassemble(data, size);
+}
+
+
+/************
+* load(const char* filename)
+*
+* Replace the catalog with the one in the index file, read in one go.
+* Returns false if the file didn't open, or isn't an index of this version,
+* in which case the catalog is left empty.
+************/
+bool RomCatalog::load(const char* filename)
+{
+	clear();
+	changed = false;
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+	if(!file.is_open())
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	file.seekg(0, std::ios::end);
+	std::vector<char> data((size_t) file.tellg());
+	file.seekg(0, std::ios::beg);
+	file.read(data.data(), data.size());
+
+	size_t position = 0;
+
+	if(!file || read_value(data, position, 4) != ROM_CATALOG_MAGIC || read_value(data, position, 1) != ROM_CATALOG_VERSION)
+	{
+		std::cout << "ERROR: File " << filename << " is not a ROM catalog!" << std::endl;
+		return false;
+	}
+
+	unsigned int num_entries = read_value(data, position, 4);
+
+	for(unsigned int i=0; i<num_entries && position <= data.size(); i++)
+	{
+		CatalogEntry* entry = new CatalogEntry;
+		const char* bytes;
+		size_t num_bytes;
+
+		bytes = read_bytes(data, position, &num_bytes);
+		entry->filename.assign(bytes, num_bytes);
+		entry->file_size = read_value(data, position, 8);
+		entry->modified = (int64_t) read_value(data, position, 8);
+
+		entry->hash = read_value(data, position, 8);
+		entry->variant = (RomVariant) read_value(data, position, 1);
+		entry->quirks = (QuirkProfile) read_value(data, position, 1);
+		entry->instructions_per_frame = read_value(data, position, 4);
+
+		bytes = read_bytes(data, position, &num_bytes);
+		entry->data.assign(bytes, bytes + num_bytes);
+		bytes = read_bytes(data, position, &num_bytes);
+		entry->disassembly.assign(bytes, num_bytes);
+
+		if(position > data.size() || entry->variant >= NUM_ROM_VARIANTS || entry->quirks >= NUM_QUIRK_PROFILES)
+		{
+			delete entry;
+			break;
+		}
+
+		insert(entry);
+	}
+
+	if(position != data.size())
+	{
+		std::cout << "ERROR: ROM catalog " << filename << " is corrupt!" << std::endl;
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+
+/************
+* save(const char* filename)
+*
+* Write the catalog to an index file.  Returns false if it couldn't be
+* written.
+************/
+bool RomCatalog::save(const char* filename)
+{
+	std::string buffer;
+
+	write_value(buffer, ROM_CATALOG_MAGIC, 4);
+	write_value(buffer, ROM_CATALOG_VERSION, 1);
+	write_value(buffer, entries.size(), 4);
+
+	for(unsigned int i=0; i<entries.size(); i++)
+	{
+		const CatalogEntry* entry = entries[i];
+
+		write_string(buffer, entry->filename);
+		write_value(buffer, entry->file_size, 8);
+		write_value(buffer, (uint64_t) entry->modified, 8);
+
+		write_value(buffer, entry->hash, 8);
+		write_value(buffer, entry->variant, 1);
+		write_value(buffer, entry->quirks, 1);
+		write_value(buffer, entry->instructions_per_frame, 4);
+
+		write_string(buffer, std::string(entry->data.begin(), entry->data.end()));
+		write_string(buffer, entry->disassembly);
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+	if(!file.is_open())
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	file.write(buffer.data(), buffer.size());
+
+	if(!file.good())
+	{
+		return false;
+	}
+
+	changed = false;
+	return true;
+}
+
+
+/************
+* add(const char* filename)
+*
+* Get the entry for a ROM file, reading and cataloging the file only if it
+* isn't in the catalog, or has changed since it was cataloged.  Returns NULL
+* if the file couldn't be read.
+************/
+const CatalogEntry* RomCatalog::add(const char* filename)
+{
+	struct stat status;
+
+	if(stat(filename, &status) != 0)
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return NULL;
+	}
+
+	std::map<std::string, CatalogEntry*>::iterator found = by_filename.find(filename);
+	CatalogEntry* entry = found == by_filename.end() ? NULL : found->second;
+
+	if(entry && entry->file_size == (uint64_t) status.st_size && entry->modified == (int64_t) status.st_mtime)
+	{
+		// The database may have changed since the ROM was cataloged
+		QuirkProfile quirks = DEFAULT_QUIRKS;
+		if(rom_database)
+		{
+			rom_database->find(entry->hash, &quirks);
+
+			if(quirks != entry->quirks)
+			{
+				entry->quirks = quirks;
+				changed = true;
+			}
+		}
+
+		return entry;
+	}
+
+	RomImage image;
+	if(!image.open(filename))
+	{
+		return NULL;
+	}
+
+	if(!entry)
+	{
+		entry = new CatalogEntry;
+		entry->filename = filename;
+		insert(entry);
+	}
+	else if(by_hash[entry->hash] == entry)
+	{
+		by_hash.erase(entry->hash);
+	}
+
+	entry->file_size = status.st_size;
+	entry->modified = status.st_mtime;
+	entry->data.assign(image.get_data(), image.get_data() + image.get_size());
+
+	describe(entry);
+	by_hash[entry->hash] = entry;
+
+	changed = true;
+	return entry;
+}
+
+
+const CatalogEntry* RomCatalog::find(const std::string& filename)
+{
+	std::map<std::string, CatalogEntry*>::iterator entry = by_filename.find(filename);
+
+	return entry == by_filename.end() ? NULL : entry->second;
+}
+
+
+const CatalogEntry* RomCatalog::find(uint64_t rom_hash)
+{
+	std::map<uint64_t, CatalogEntry*>::iterator entry = by_hash.find(rom_hash);
+
+	return entry == by_hash.end() ? NULL : entry->second;
+}
+
+
+unsigned int RomCatalog::get_size()
+{
+	return entries.size();
+}
+
+
+/************
+* is_changed()
+*
+* Whether the catalog has changed since it was loaded or saved, and the index
+* should be saved again
+************/
+bool RomCatalog::is_changed()
+{
+	return changed;
+}
+
+
+/************
+* detect_variant(filename, data, size)
+*
+* Work out which chip the ROM was written for.  Chip-8X ROMs are told by their
+* extension.  Otherwise, the code reachable from the start of the program is
+* traced, following jumps, calls and skips, and checked for MegaChip and SCHIP
+* instructions.  Sprites and other data often look like SCHIP instructions,
+* so only code which can be reached is checked.
+************/
+RomVariant RomCatalog::detect_variant(const std::string& filename, const unsigned char* data, unsigned int size)
+{
+	if(filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".c8x") == 0)
+	{
+		return CHIP8X_ROM;
+	}
+
+	std::vector<bool> visited(size, false);
+	std::vector<unsigned short> pending(1, PROGRAM_START);
+	bool super_chip = false;
+
+	while(!pending.empty())
+	{
+		unsigned int address = pending.back();
+		pending.pop_back();
+
+		while(address >= PROGRAM_START && address + 1 < PROGRAM_START + size && !visited[address - PROGRAM_START])
+		{
+			visited[address - PROGRAM_START] = true;
+
+			unsigned short opcode = (data[address - PROGRAM_START] << 8) | data[address - PROGRAM_START + 1];
+			unsigned char value = opcode & 0x00FF;
+			address += 2;
+
+			// Enable MegaChip mode
+			if(opcode == 0x0011)
+			{
+				return MEGACHIP_ROM;
+			}
+
+			if((opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF) ||
+			   ((opcode & 0xF000) == 0xF000 && (value == 0x30 || value == 0x75 || value == 0x85)))
+			{
+				super_chip = true;
+			}
+
+			// Follow the flow of the program
+			if(opcode == 0x00EE || opcode == 0x00FD || (opcode & 0xF000) == 0xB000)
+			{
+				break;
+			}
+
+			switch(opcode & 0xF000)
+			{
+				case 0x1000:
+					address = opcode & 0x0FFF;
+					break;
+
+				case 0x2000:
+					pending.push_back(opcode & 0x0FFF);
+					break;
+
+				case 0x3000:
+				case 0x4000:
+				case 0x5000:
+				case 0x9000:
+					pending.push_back(address + 2);
+					break;
+
+				case 0xE000:
+					if(value == 0x9E || value == 0xA1)
+					{
+						pending.push_back(address + 2);
+					}
+					break;
+			}
+		}
+	}
+
+	return super_chip ? SCHIP_ROM : CHIP8_ROM;
+}
+
+
+unsigned int RomCatalog::get_instructions_per_frame(RomVariant variant)
+{
+	if(variant >= NUM_ROM_VARIANTS)
+	{
+		return DEFAULT_INSTRUCTIONS_PER_FRAME;
+	}
+
+	return ROM_VARIANTS[variant].instructions_per_frame;
+}
+
+
+const char* RomCatalog::get_variant_name(RomVariant variant)
+{
+	if(variant >= NUM_ROM_VARIANTS)
+	{
+		return "unknown";
+	}
+
+	return ROM_VARIANTS[variant].name;
+}
+
+
+/************
+* disassemble(data, size)
+*
+* A listing of the ROM, with every pair of bytes disassembled as an
+* instruction, one per line:  the address, the raw opcode and the
+* instruction.  A trailing odd byte is listed as it is.
+************/
+std::string RomCatalog::disassemble(const unsigned char* data, unsigned int size)
+{
+	Disassembler disassembler;
+	disassembler.create_operation_name_map();
+
+	std::stringstream listing;
+	listing << std::hex << std::setfill('0');
+
+	for(unsigned int i=0; i<size; i+=2)
+	{
+		unsigned int address = PROGRAM_START + i;
+		listing << "0x" << std::setw(3) << address << "\t";
+
+		if(i + 1 < size)
+		{
+			unsigned short opcode = (data[i] << 8) | data[i + 1];
+			listing << std::setw(4) << opcode << "\t" << disassembler.disassemble(address, opcode) << "\n";
+		}
+		else
+		{
+			listing << std::setw(2) << (unsigned short) data[i] << "\n";
+		}
+	}
+
+	return listing.str();
+}
@@ -0,0 +1,117 @@
+#include "core/rom_database.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+RomDatabase::RomDatabase()
+{
+}
+
+
+/************
+* load(const char* filename)
+*
+* Add the ROMs listed in the file to the database.  Returns false if the file
+* didn't open, or a line couldn't be read, in which case the lines before it
+* are still added.
+************/
+bool RomDatabase::load(const char* filename)
+{
+	std::ifstream file(filename);
+
+	if(!file.is_open())
+	{
+		std::cout << "ERROR: File " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	unsigned int line_number = 0;
+
+	while(std::getline(file, line))
+	{
+		line_number++;
+
+		std::stringstream fields(line);
+		std::string hash_text, profile_name;
+
+		// Skip blank lines and comments
+		if(!(fields >> hash_text) || hash_text[0] == '#')
+		{
+			continue;
+		}
+
+		char* end;
+		uint64_t rom_hash = strtoull(hash_text.c_str(), &end, 16);
+		QuirkProfile profile;
+
+		if(*end != '\0' || !(fields >> profile_name) || !find_quirk_profile(profile_name, &profile))
+		{
+			std::cout << "ERROR: Line " << std::dec << line_number << " of " << filename << " is not a ROM and quirk profile!" << std::endl;
+			return false;
+		}
+
+		add(rom_hash, profile);
+	}
+
+	return true;
+}
+
+
+void RomDatabase::add(uint64_t rom_hash, QuirkProfile profile)
+{
+	profiles[rom_hash] = profile;
+}
+
+
+/************
+* find(uint64_t hash, QuirkProfile* profile)
+*
+* Look up the quirk profile of the ROM with the hash.  Returns false if the ROM
+* isn't in the database.
+************/
+bool RomDatabase::find(uint64_t rom_hash, QuirkProfile* profile)
+{
+	std::map<uint64_t, QuirkProfile>::iterator entry = profiles.find(rom_hash);
+
+	if(entry == profiles.end())
+	{
+		return false;
+	}
+
+	*profile = entry->second;
+	return true;
+}
+
+
+bool RomDatabase::find(const unsigned char* data, unsigned int size, QuirkProfile* profile)
+{
+	return find(hash(data, size), profile);
+}
+
+
+unsigned int RomDatabase::get_size()
+{
+	return profiles.size();
+}
+
+
+/************
+* hash(const unsigned char* data, unsigned int size)
+*
+* The hash (FNV-1a) of a ROM, as used in the database
+************/
+uint64_t RomDatabase::hash(const unsigned char* data, unsigned int size)
+{
+	uint64_t rom_hash = 14695981039346656037ULL;
+	for(unsigned int i=0; i<size; i++)
+	{
+		rom_hash ^= data[i];
+		rom_hash *= 1099511628211ULL;
+	}
+
+	return rom_hash;
+}
@@ -0,0 +1,217 @@
+#include "core/rom_image.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RomImage::RomImage()
+{
+	data = NULL;
+	size = 0;
+	mapped = false;
+}
+
+
+RomImage::~RomImage()
+{
+	close();
+}
+
+
+/************
+* open(const std::string& filename)
+*
+* Map the ROM file into memory, replacing any file already open.  Returns
+* false if the file couldn't be mapped.
+************/
+bool RomImage::open(const std::string& _filename)
+{
+	close();
+
+	int file = ::open(_filename.c_str(), O_RDONLY);
+
+	if(file < 0)
+	{
+		std::cout << "ERROR: File " << _filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	struct stat status;
+	if(fstat(file, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		std::cout << "ERROR: File " << _filename << " is not a ROM!" << std::endl;
+		::close(file);
+		return false;
+	}
+
+	// An empty file can't be mapped, but is a valid (empty) program
+	if(status.st_size > 0)
+	{
+		void* mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+		if(mapping == MAP_FAILED)
+		{
+			std::cout << "ERROR: File " << _filename << " could not be mapped!" << std::endl;
+			::close(file);
+			return false;
+		}
+
+		data = (const unsigned char*) mapping;
+		mapped = true;
+	}
+
+	// The mapping stays valid once the file is closed
+	::close(file);
+
+	filename = _filename;
+	size = status.st_size;
+
+	return true;
+}
+
+
+void RomImage::close()
+{
+	if(mapped)
+	{
+		munmap((void*) data, size);
+	}
+
+	filename.clear();
+	data = NULL;
+	size = 0;
+	mapped = false;
+}
+
+
+const std::string& RomImage::get_filename()
+{
+	return filename;
+}
+
+
+const unsigned char* RomImage::get_data()
+{
+	return data;
+}
+
+
+unsigned int RomImage::get_size()
+{
+	return size;
+}
+
+
+/************
+* fits(Memory* memory)
+*
+* Whether the whole program fits in the RAM of the memory
+************/
+bool RomImage::fits(Memory* memory)
+{
+	return fits(memory, size);
+}
+
+
+bool RomImage::fits(Memory* memory, unsigned int size)
+{
+	return size <= (unsigned int) (MEMORY_SIZE - memory->get_ram_start());
+}
+
+
+/************
+* load(Memory* memory)
+*
+* Copy the program into the RAM of the memory.  A program too big for RAM is
+* reported, and truncated.  Returns the number of bytes loaded.
+************/
+unsigned int RomImage::load(Memory* memory)
+{
+	return load(memory, filename, data, size);
+}
+
+
+/************
+* load(Memory* memory, const std::string& filename, const unsigned char* data, unsigned int size)
+*
+* Copy a program read from the file into the RAM of the memory, e.g., from a
+* ROM catalog.  A program too big for RAM is reported, and truncated.
+* Returns the number of bytes loaded.
+************/
+unsigned int RomImage::load(Memory* memory, const std::string& filename, const unsigned char* data, unsigned int size)
+{
+	if(!fits(memory, size))
+	{
+		std::cout << "ERROR: Program " << filename << " is " << std::dec << size << " bytes, and won't fit in RAM!" << std::endl;
+	}
+
+	return memory->load_program(data, size);
+}
+
+
+/************
+* find_roms(const std::string& directory, std::vector<std::string>& filenames)
+*
+* Add the ROM files (.ch8 and .c8x) in the directory, and every directory
+* below it, to the filenames, sorted so the order is the same on every run.
+* Returns false if the directory couldn't be read.
+************/
+bool RomImage::find_roms(const std::string& directory, std::vector<std::string>& filenames)
+{
+	DIR* dir = opendir(directory.c_str());
+
+	if(!dir)
+	{
+		std::cout << "ERROR: Directory " << directory << " did not open!" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> roms;
+	std::vector<std::string> subdirectories;
+
+	struct dirent* item;
+	while((item = readdir(dir)) != NULL)
+	{
+		std::string name = item->d_name;
+		if(name == "." || name == "..")
+		{
+			continue;
+		}
+
+		std::string path = directory + "/" + name;
+
+		struct stat status;
+		if(stat(path.c_str(), &status) != 0)
+		{
+			continue;
+		}
+
+		if(S_ISDIR(status.st_mode))
+		{
+			subdirectories.push_back(path);
+		}
+		else if(name.size() > 4 && (name.compare(name.size() - 4, 4, ".ch8") == 0 || name.compare(name.size() - 4, 4, ".c8x") == 0))
+		{
+			roms.push_back(path);
+		}
+	}
+
+	closedir(dir);
+
+	std::sort(roms.begin(), roms.end());
+	std::sort(subdirectories.begin(), subdirectories.end());
+
+	filenames.insert(filenames.end(), roms.begin(), roms.end());
+
+	for(unsigned int i=0; i<subdirectories.size(); i++)
+	{
+		find_roms(subdirectories[i], filenames);
+	}
+
+	return true;
+}
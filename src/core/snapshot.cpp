@@ -0,0 +1,285 @@
+#include "core/snapshot.h"
+
+#include <string.h>
+
+Snapshot::Snapshot()
+{
+	size = 0;
+	position = 0;
+	section = 0;
+	valid = false;
+}
+
+
+/*******************
+* begin()
+*
+* Discard the contents of the snapshot, and write the header of a new one
+*******************/
+void Snapshot::begin()
+{
+	size = 0;
+	position = 0;
+	section = 0;
+	valid = true;
+
+	write_short(SNAPSHOT_MAGIC & 0xFFFF);
+	write_short(SNAPSHOT_MAGIC >> 16);
+	write_byte(SNAPSHOT_VERSION);
+}
+
+
+/*******************
+* open()
+*
+* Start reading the snapshot from the beginning.  Returns false if the header
+* isn't that of a snapshot of this version.
+*******************/
+bool Snapshot::open()
+{
+	position = 0;
+	section = 0;
+	valid = true;
+
+	unsigned long magic = read_short();
+	magic |= ((unsigned long) read_short()) << 16;
+	unsigned char version = read_byte();
+
+	if(magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION)
+	{
+		valid = false;
+	}
+
+	return valid;
+}
+
+
+bool Snapshot::is_valid()
+{
+	return valid;
+}
+
+
+const unsigned char* Snapshot::get_data()
+{
+	return data;
+}
+
+
+unsigned int Snapshot::get_size()
+{
+	return size;
+}
+
+
+/*******************
+* get_hash()
+*
+* A hash (FNV-1a) of the snapshot, to compare states cheaply
+*******************/
+uint64_t Snapshot::get_hash()
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(unsigned int i=0; i<size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+
+/*******************
+* set_data(const unsigned char* data, unsigned int size)
+*
+* Copy in a snapshot, e.g., read from a file.  Returns false if it is too big.
+*******************/
+bool Snapshot::set_data(const unsigned char* _data, unsigned int _size)
+{
+	if(_size > SNAPSHOT_CAPACITY)
+	{
+		size = 0;
+		valid = false;
+		return false;
+	}
+
+	memcpy(data, _data, _size);
+	size = _size;
+	position = 0;
+	valid = true;
+
+	return true;
+}
+
+
+/*******************
+* begin_section(unsigned char tag)
+*
+* Start writing a section.  A section is its tag, followed by its length in
+* bytes, and its contents.  The length is filled in by end_section().
+*******************/
+void Snapshot::begin_section(unsigned char tag)
+{
+	write_byte(tag);
+	section = position;
+	write_short(0);
+}
+
+
+void Snapshot::end_section()
+{
+	unsigned int length = position - section - 2;
+
+	if(valid && length <= 0xFFFF)
+	{
+		data[section] = length & 0xFF;
+		data[section + 1] = length >> 8;
+	}
+	else
+	{
+		valid = false;
+	}
+}
+
+
+/*******************
+* open_section(unsigned char tag)
+*
+* Start reading the next section, which should have the given tag.  Returns
+* false if it doesn't.
+*******************/
+bool Snapshot::open_section(unsigned char tag)
+{
+	unsigned char section_tag = read_byte();
+	unsigned short length = read_short();
+
+	if(section_tag != tag || position + length > size)
+	{
+		valid = false;
+	}
+
+	section = position + length;
+
+	return valid;
+}
+
+
+/*******************
+* close_section()
+*
+* Finish reading a section.  Returns false if the snapshot is invalid, or the
+* contents of the section weren't read exactly.
+*******************/
+bool Snapshot::close_section()
+{
+	if(position != section)
+	{
+		valid = false;
+	}
+
+	return valid;
+}
+
+
+void Snapshot::write_byte(unsigned char value)
+{
+	if(position + 1 > SNAPSHOT_CAPACITY)
+	{
+		valid = false;
+		return;
+	}
+
+	data[position++] = value;
+	size = position;
+}
+
+
+void Snapshot::write_short(unsigned short value)
+{
+	write_byte(value & 0xFF);
+	write_byte(value >> 8);
+}
+
+
+void Snapshot::write_word(uint64_t value)
+{
+	if(position + 8 > SNAPSHOT_CAPACITY)
+	{
+		valid = false;
+		return;
+	}
+
+	for(int i=0; i<8; i++)
+	{
+		data[position++] = (value >> (8*i)) & 0xFF;
+	}
+	size = position;
+}
+
+
+void Snapshot::write_bytes(const unsigned char* values, unsigned int length)
+{
+	if(position + length > SNAPSHOT_CAPACITY)
+	{
+		valid = false;
+		return;
+	}
+
+	memcpy(&data[position], values, length);
+	position += length;
+	size = position;
+}
+
+
+unsigned char Snapshot::read_byte()
+{
+	if(position + 1 > size)
+	{
+		valid = false;
+		return 0;
+	}
+
+	return data[position++];
+}
+
+
+unsigned short Snapshot::read_short()
+{
+	unsigned short value = read_byte();
+	value |= read_byte() << 8;
+
+	return value;
+}
+
+
+uint64_t Snapshot::read_word()
+{
+	if(position + 8 > size)
+	{
+		valid = false;
+		return 0;
+	}
+
+	uint64_t value = 0;
+	for(int i=0; i<8; i++)
+	{
+		value |= ((uint64_t) data[position++]) << (8*i);
+	}
+
+	return value;
+}
+
+
+void Snapshot::read_bytes(unsigned char* values, unsigned int length)
+{
+	if(position + length > size)
+	{
+		valid = false;
+		memset(values, 0, length);
+		return;
+	}
+
+	memcpy(values, &data[position], length);
+	position += length;
+}
@@ -1,4 +1,4 @@
-#include "disassembler.h"
+#include "disassembler/disassembler.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,12 +10,15 @@
 
 Disassembler::Disassembler()
 {
-
+	_program = NULL;
+	operation_name_map = NULL;
+	program_size = 0;
 }
 
 Disassembler::~Disassembler()
 {
-
+	delete [] _program;
+	delete operation_name_map;
 }
 
 
@@ -149,15 +152,7 @@ void Disassembler::decode()
 	{
 		_program[i].opcode = get_opcode(_program[i].raw_code);
 
-		std::map<unsigned short, const char*>::iterator it = operation_name_map->find(_program[i].opcode);
-		if(it != operation_name_map->end())
-		{
-			_program[i].mnemonic = it->second;
-		}
-		else
-		{
-			_program[i].mnemonic = "UNK ";
-		}
+		_program[i].mnemonic = get_mnemonic(_program[i].opcode);
 		_program[i].address_register = _program[i].raw_code & 0x0FFF;
 		_program[i].register_x = (_program[i].raw_code & 0x0F00) >> 8;
 		_program[i].register_y = (_program[i].raw_code & 0x00F0) >> 4;
@@ -424,6 +419,51 @@ std::string Disassembler::decompile_command(Code code)
 }
 
 
+/*******************
+* disassemble(unsigned short address, unsigned short raw_code)
+*
+* Decompile a single instruction, e.g., one seen executing, without loading
+* a program.  The operation name map must have been created.
+*******************/
+std::string Disassembler::disassemble(unsigned short address, unsigned short raw_code)
+{
+	Code code;
+	code.type = INSTRUCTION;
+	code.address = address;
+	code.raw_code = raw_code;
+	code.opcode = get_opcode(raw_code);
+	code.mnemonic = get_mnemonic(code.opcode);
+	code.address_register = raw_code & 0x0FFF;
+	code.register_x = (raw_code & 0x0F00) >> 8;
+	code.register_y = (raw_code & 0x00F0) >> 4;
+	code.value = raw_code & 0x00FF;
+
+	if(code.opcode == DRAW)
+	{
+		code.value = code.value & 0x000F;
+	}
+
+	return decompile_command(code);
+}
+
+
+/*******************
+* get_mnemonic(unsigned short opcode)
+*
+* The name of the operation, as returned by get_opcode()
+*******************/
+const char* Disassembler::get_mnemonic(unsigned short opcode)
+{
+	std::map<unsigned short, const char*>::iterator it = operation_name_map->find(opcode);
+	if(it != operation_name_map->end())
+	{
+		return it->second;
+	}
+
+	return "UNK ";
+}
+
+
 unsigned short Disassembler::get_opcode(unsigned short code)
 {
 	// Opcodes are generally organized by the first nybble
@@ -454,7 +494,7 @@ unsigned short Disassembler::get_opcode(unsigned short code)
 			// Check the SChip-8 commands
 			if(code == SCROLL_LEFT || code == SCROLL_RIGHT || code == EXIT || code == LORES_MODE || code == HIRES_MODE)
 				return code;
-			if(code & 0x00F0 == SCROLL_DOWN)
+			if((code & 0xFFF0) == SCROLL_DOWN)
 				return SCROLL_DOWN;
 			// Otherwise, it should be considered a system call
 			else
@@ -520,22 +560,3 @@ unsigned short Disassembler::get_opcode(unsigned short code)
 	}
 }
 
-
-int main(int argc, char** argv)
-{
-	// Make sure that a filename is provided to disassemble
-	if(argc < 2)
-	{
-		std::cout << "Binary file not provided!  USAGE:  Disassemble <program.ch8>" << std::endl;
-		return 0;
-	}
-
-	Disassembler* disassembler = new Disassembler();
-	disassembler->create_operation_name_map();
-	disassembler->load_rom(argv[1]);
-	disassembler->decode();
-	disassembler->trace();
-	disassembler->print();
-
-	return 0;
-}
\ No newline at end of file
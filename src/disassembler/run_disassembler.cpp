@@ -0,0 +1,32 @@
+/*******************
+* run_disassembler.cpp
+*
+* Disassemble a CHIP-8 / SCHIP program, tracing the flow of the program to
+* tell instructions from data
+*/
+
+#include "disassembler/disassembler.h"
+
+#include <iostream>
+
+
+int main(int argc, char** argv)
+{
+	// Make sure that a filename is provided to disassemble
+	if(argc < 2)
+	{
+		std::cout << "Binary file not provided!  USAGE:  Disassemble <program.ch8>" << std::endl;
+		return 0;
+	}
+
+	Disassembler* disassembler = new Disassembler();
+	disassembler->create_operation_name_map();
+	disassembler->load_rom(argv[1]);
+	disassembler->decode();
+	disassembler->trace();
+	disassembler->print();
+
+	delete disassembler;
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,292 @@
+/*******************
+* display_benchmark.cpp
+*
+* Time the display scroll and clear operations with each set of display
+* kernels the processor supports, at the CHIP-8 and SCHIP hires display
+* sizes.  The same operations on the original bool** display are timed
+* first, as a reference.
+*/
+
+#include "core/display.h"
+#include "core/display_kernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define DEFAULT_REPETITIONS		1000000
+
+
+/******************
+* ReferenceDisplay
+*
+* A copy of the original display, with a bool for each pixel, stored a column
+* at a time, and the same scroll and clear loops
+******************/
+class ReferenceDisplay
+{
+	private:
+		bool** display;
+		unsigned int width, height;
+
+	public:
+		ReferenceDisplay(unsigned int _width, unsigned int _height)
+		{
+			width = _width;
+			height = _height;
+
+			display = new bool*[width];
+			for(unsigned int i=0; i<width; i++)
+			{
+				display[i] = new bool[height];
+				for(unsigned int j=0; j<height; j++)
+				{
+					display[i][j] = false;
+				}
+			}
+		}
+
+		~ReferenceDisplay()
+		{
+			for(unsigned int i=0; i<width; i++)
+			{
+				delete [] display[i];
+			}
+			delete [] display;
+		}
+
+		bool write_line(unsigned char x, unsigned char y, unsigned char value)
+		{
+			unsigned char _y = y % height;
+			bool collision = false;
+
+			for(int i=0; i<8; i++)
+			{
+				bool is_high = ((value >> (7-i)) & 0x01) == 0x01;
+				unsigned char _x = (unsigned char) (x + i) % width;
+
+				if(display[_x][_y] == is_high)
+				{
+					if(is_high)
+					{
+						collision = true;
+					}
+					display[_x][_y] = false;
+				}
+				else
+				{
+					display[_x][_y] = true;
+				}
+			}
+
+			return collision;
+		}
+
+		void clear()
+		{
+			for(unsigned int x=0; x<width; x++)
+			{
+				for(unsigned int y=0; y<height; y++)
+				{
+					display[x][y] = false;
+				}
+			}
+		}
+
+		void scroll_down(unsigned char num_rows)
+		{
+			for(int j=height-num_rows-1; j>=0; j--)
+			{
+				for(unsigned int i=0; i<width; i++)
+				{
+					display[i][j+num_rows] = display[i][j];
+				}
+			}
+
+			for(unsigned int i=0; i<width; i++)
+			{
+				for(unsigned int j=0; j<num_rows; j++)
+				{
+					display[i][j] = false;
+				}
+			}
+		}
+
+		void scroll_left(unsigned char num_cols)
+		{
+			for(unsigned int i=num_cols; i<width; i++)
+			{
+				for(unsigned int j=0; j<height; j++)
+				{
+					display[i-num_cols][j] = display[i][j];
+				}
+			}
+
+			for(unsigned int i=width-num_cols; i<width; i++)
+			{
+				for(unsigned int j=0; j<height; j++)
+				{
+					display[i][j] = false;
+				}
+			}
+		}
+
+		void scroll_right(unsigned char num_cols)
+		{
+			for(int i=width-num_cols-1; i>=0; i--)
+			{
+				for(unsigned int j=0; j<height; j++)
+				{
+					display[i+num_cols][j] = display[i][j];
+				}
+			}
+
+			for(unsigned int i=0; i<num_cols; i++)
+			{
+				for(unsigned int j=0; j<height; j++)
+				{
+					display[i][j] = false;
+				}
+			}
+		}
+};
+
+
+typedef void (*DisplayOperation)(Display*);
+typedef void (*ReferenceOperation)(ReferenceDisplay*);
+
+void scroll_left(Display* display)
+{
+	display->scroll_left(4);
+}
+
+void scroll_right(Display* display)
+{
+	display->scroll_right(4);
+}
+
+void scroll_down(Display* display)
+{
+	display->scroll_down(4);
+}
+
+void clear(Display* display)
+{
+	display->clear();
+}
+
+void reference_scroll_left(ReferenceDisplay* display)
+{
+	display->scroll_left(4);
+}
+
+void reference_scroll_right(ReferenceDisplay* display)
+{
+	display->scroll_right(4);
+}
+
+void reference_scroll_down(ReferenceDisplay* display)
+{
+	display->scroll_down(4);
+}
+
+void reference_clear(ReferenceDisplay* display)
+{
+	display->clear();
+}
+
+
+/*****
+* time_operation(display, operation, repetitions)
+*
+* Returns the average time of the operation, in nanoseconds
+*****/
+double time_operation(Display* display, DisplayOperation operation, unsigned long repetitions)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for(unsigned long i=0; i<repetitions; i++)
+	{
+		// Keep some pixels on the screen, so scrolling has something to move
+		display->write_line(i, i >> 6, i);
+
+		operation(display);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return seconds * 1e9 / repetitions;
+}
+
+
+/*****
+* time_reference(display, operation, repetitions)
+*
+* As time_operation(), for the reference display
+*****/
+double time_reference(ReferenceDisplay* display, ReferenceOperation operation, unsigned long repetitions)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for(unsigned long i=0; i<repetitions; i++)
+	{
+		display->write_line(i, i >> 6, i);
+
+		operation(display);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return seconds * 1e9 / repetitions;
+}
+
+
+int main(int argc, char** argv)
+{
+	unsigned long repetitions = DEFAULT_REPETITIONS;
+	if(argc > 1)
+	{
+		repetitions = strtoul(argv[1], NULL, 0);
+	}
+
+	const char* operation_names[] = {"scroll_left(4)", "scroll_right(4)", "scroll_down(4)", "clear()"};
+	DisplayOperation operations[] = {scroll_left, scroll_right, scroll_down, clear};
+	ReferenceOperation reference_operations[] = {reference_scroll_left, reference_scroll_right, reference_scroll_down, reference_clear};
+
+	unsigned int sizes[][2] = {{64, 32}, {128, 64}};
+	DisplayKernelSet kernel_sets[] = {SCALAR_KERNELS, SSE2_KERNELS, AVX2_KERNELS};
+
+	printf("Default kernels:  %s\n", get_display_kernels()->name);
+	printf("%-10s %-16s %-8s %10s\n", "size", "operation", "kernels", "ns/op");
+
+	for(int s=0; s<2; s++)
+	{
+		for(int o=0; o<4; o++)
+		{
+			char size[16];
+			snprintf(size, sizeof(size), "%ux%u", sizes[s][0], sizes[s][1]);
+
+			ReferenceDisplay reference(sizes[s][0], sizes[s][1]);
+			double reference_time = time_reference(&reference, reference_operations[o], repetitions);
+			printf("%-10s %-16s %-8s %10.2f\n", size, operation_names[o], "bool**", reference_time);
+
+			for(int k=0; k<3; k++)
+			{
+				const DisplayKernels* kernels = get_display_kernels(kernel_sets[k]);
+				if(!kernels)
+				{
+					continue;
+				}
+
+				Display display(sizes[s][0], sizes[s][1]);
+				display.set_kernels(kernels);
+
+				double time = time_operation(&display, operations[o], repetitions);
+
+				printf("%-10s %-16s %-8s %10.2f\n", size, operation_names[o], kernels->name, time);
+			}
+		}
+	}
+
+	return 0;
+}
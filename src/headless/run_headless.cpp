@@ -0,0 +1,658 @@
+/*******************
+* run_headless.cpp
+*
+* Run a batch of CHIP-8 / SCHIP programs without a GUI or clock, and report
+* the final state of each.  Every program can be run as several independent
+* instances.  Instances are shared between a fixed pool of worker threads (one
+* per core by default), each of which runs its instances to completion, one
+* at a time, so the batch can be much larger than the number of threads.
+*
+* For each instance, a hash of the display and the final register state are
+* written to standard output, one line per instance, in the order the
+* programs were given.  Built with CHECKED_MEMORY, the number of accesses
+* outside of memory or writes outside of RAM is added to the line of any
+* instance which made them.
+*
+* Instances can also record a rewind history, and step back through it at the
+* end of the run, in which case the state reported is the rewound one.
+*
+* Given a replay, each instance plays it back as fast as possible, and
+* reports whether it reached the same state as when it was recorded.
+*
+* Instances can also be profiled, in which case a report of the hottest
+* instructions and loops of each is written to a file.
+*
+* Programs run with the default quirks, or a quirk profile given for all of
+* them, and a ROM database can pick the profile of each program it lists.
+*
+* Programs can be read through a ROM catalog, kept in an index file, so
+* programs which haven't changed since the last run aren't read again, and
+* run with the quirk profile cataloged for them.  Otherwise, each program file
+* is mapped into memory, and its instances copy it straight from the mapping.
+* Given a directory, every program below it is run.
+*/
+
+#include "core/memory.h"
+#include "core/keyboard.h"
+#include "core/display.h"
+#include "core/chip8.h"
+#include "core/schip8.h"
+#include "core/clock.h"
+#include "core/computer.h"
+#include "core/rewind.h"
+#include "core/replay.h"
+#include "core/profiler.h"
+#include "core/rom_database.h"
+#include "core/rom_catalog.h"
+#include "core/rom_image.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#define DEFAULT_INSTRUCTION_BUDGET			100000
+
+
+// The data of a program is in the mapping of its file, or in the catalog
+typedef struct Program_Struct {
+	std::string filename;
+	const unsigned char* data;
+	unsigned int size;
+	QuirkProfile quirks;
+} Program;
+
+
+typedef struct Job_Struct {
+	unsigned int program;
+	unsigned int instance;
+} Job;
+
+
+typedef struct Settings_Struct {
+	unsigned long instruction_budget;
+	unsigned int instructions_per_frame;
+	ExecutionEngine engine;
+	bool chip8_only;
+	unsigned int rewind_frames;
+	const Replay* replay;
+	bool seeded;
+	unsigned int seed;
+	bool profiling;
+} Settings;
+
+
+/*****
+* load_program_list(filename, filenames)
+*
+* Read a list of program filenames, one per line
+*****/
+bool load_program_list(const std::string& filename, std::vector<std::string>& filenames)
+{
+	std::ifstream listfile(filename.c_str());
+
+	if(!listfile.is_open())
+	{
+		std::cerr << "ERROR: List " << filename << " did not open!" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while(std::getline(listfile, line))
+	{
+		if(!line.empty())
+		{
+			filenames.push_back(line);
+		}
+	}
+
+	return true;
+}
+
+
+/*****
+* run_instance(program, job, settings, instructions, profile)
+*
+* Create a chip, load the program and run it for the instruction budget.
+* Returns the report line for the instance, and adds the number of
+* instructions executed to instructions.  If profiling, the profile of the
+* instance is written to profile.
+*****/
+std::string run_instance(const Program& program, const Job& job, const Settings& settings, unsigned long& instructions, std::string& profile)
+{
+	Memory* memory = new Memory();
+	Display* display = new Display();
+	Keyboard* keyboard = new Keyboard();
+
+	Chip8* chip;
+	if(settings.chip8_only)
+	{
+		chip = new Chip8(memory, display, keyboard);
+	}
+	else
+	{
+		chip = new SChip8(memory, display, keyboard);
+	}
+
+	chip->reset();
+	chip->set_engine(settings.engine);
+	chip->set_quirks(program.quirks);
+
+	Profiler* profiler = NULL;
+	if(settings.profiling)
+	{
+		profiler = new Profiler();
+		chip->set_profiler(profiler);
+	}
+
+	// Each instance of a program gets its own sequence of random numbers
+	if(settings.seeded)
+	{
+		chip->set_seed(settings.seed + job.instance);
+	}
+
+	// Load the program into memory, truncating anything which won't fit
+	memory->load_program(program.data, program.size);
+
+	// Run frames on this thread, without starting the clock's own thread
+	Clock clock(chip);
+	clock.set_instructions_per_frame(settings.instructions_per_frame);
+
+	Computer computer(chip, &clock, memory, display, keyboard);
+	Rewind* rewind = NULL;
+	if(settings.rewind_frames > 0)
+	{
+		rewind = new Rewind(&computer);
+		clock.set_rewind(rewind);
+	}
+
+	Replay* replay = NULL;
+	bool replay_started = false;
+	if(settings.replay)
+	{
+		replay = new Replay(*settings.replay);
+		replay_started = replay->play(&computer);
+		clock.add_listener(replay);
+	}
+
+	// A replay keeps running after the program exits, as it did when recorded
+	unsigned long remaining = settings.instruction_budget;
+	while(remaining > 0 && (!chip->is_halted() || replay))
+	{
+		// The budget may end part way through a frame
+		if(remaining < settings.instructions_per_frame)
+		{
+			clock.set_instructions_per_frame(remaining);
+		}
+
+		remaining -= clock.get_instructions_per_frame();
+		instructions += clock.run_frame();
+	}
+
+	std::string replay_result;
+	if(replay)
+	{
+		if(!replay_started)
+		{
+			replay_result = "REPLAY START DIFFERS ";
+		}
+		else if(replay->check())
+		{
+			replay_result = "REPLAY OK ";
+		}
+		else
+		{
+			replay_result = "REPLAY DIFFERS ";
+		}
+
+		replay->stop();
+	}
+
+	// Step back through the history, as far as it goes
+	if(rewind)
+	{
+		clock.set_rewinding(true);
+		for(unsigned int i=0; i<settings.rewind_frames && rewind->get_num_frames() > 0; i++)
+		{
+			clock.run_frame();
+		}
+		clock.set_rewinding(false);
+	}
+
+	// Hash the display (FNV-1a)
+	unsigned long long hash = 14695981039346656037ULL;
+	for(unsigned int y=0; y<display->get_height(); y++)
+	{
+		for(unsigned int x=0; x<display->get_width(); x++)
+		{
+			hash ^= display->get_pixel(x, y) ? 1 : 0;
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	char line[256];
+	int length = snprintf(line, sizeof(line), "%016llx PC=%03X I=%03X SP=%02X V=",
+	                      hash, chip->get_program_counter(), chip->get_address(), chip->get_stack_pointer());
+	for(int i=0; i<0x10; i++)
+	{
+		length += snprintf(line + length, sizeof(line) - length, "%02X", chip->get_register(i));
+	}
+
+	std::string report = std::string(line) + (chip->is_halted() ? " HALTED " : " ") + replay_result + program.filename;
+	if(job.instance > 0)
+	{
+		report += " #" + std::to_string(job.instance);
+	}
+
+	// Only counted when built with CHECKED_MEMORY
+	if(memory->get_violations() > 0)
+	{
+		report += " (" + std::to_string(memory->get_violations()) + " memory violations)";
+	}
+
+	if(profiler)
+	{
+		std::stringstream ss;
+		ss << "== " << program.filename;
+		if(job.instance > 0)
+		{
+			ss << " #" << job.instance;
+		}
+		ss << std::endl;
+
+		profiler->report(ss);
+		ss << std::endl;
+
+		profile = ss.str();
+	}
+
+	delete replay;
+	delete rewind;
+	delete profiler;
+	delete chip;
+	delete keyboard;
+	delete display;
+	delete memory;
+
+	return report;
+}
+
+
+/*****
+* run_jobs()
+*
+* Worker thread loop.  Take the next job until there are none left.
+*****/
+void run_jobs(const std::vector<Program>* programs, const std::vector<Job>* jobs, const Settings* settings,
+              std::atomic<unsigned int>* next_job, std::vector<std::string>* reports, std::vector<std::string>* profiles,
+              std::atomic<unsigned long>* total_instructions)
+{
+	unsigned long instructions = 0;
+
+	unsigned int job_number;
+	while((job_number = next_job->fetch_add(1)) < jobs->size())
+	{
+		const Job& job = (*jobs)[job_number];
+		(*reports)[job_number] = run_instance((*programs)[job.program], job, *settings, instructions, (*profiles)[job_number]);
+	}
+
+	*total_instructions += instructions;
+}
+
+
+void print_usage()
+{
+	std::cerr << "USAGE:  RunChip8Headless [options] <program.ch8 | @list.txt | directory> ..." << std::endl;
+	std::cerr << "  -n <instances>     Number of instances of each program (default 1)" << std::endl;
+	std::cerr << "  -i <instructions>  Instruction budget for each instance (default " << DEFAULT_INSTRUCTION_BUDGET << ")" << std::endl;
+	std::cerr << "  -f <frames>        Frame budget for each instance, instead of an instruction budget" << std::endl;
+	std::cerr << "  -p <instructions>  Instructions per 60Hz frame (default " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")" << std::endl;
+	std::cerr << "  -e <engine>        Execution engine:  step, block or recompiler (default step)" << std::endl;
+	std::cerr << "  -j <workers>       Number of worker threads (default one per core)" << std::endl;
+	std::cerr << "  -r <frames>        Record a rewind history, and step back this many frames at the end" << std::endl;
+	std::cerr << "  -s <seed>          Seed the random number generator of instance n with seed + n (default the time)" << std::endl;
+	std::cerr << "  -P <replay>        Play back a replay of the program, and check it reaches the recorded state" << std::endl;
+	std::cerr << "  -o <profile>       Profile each instance (stepping every instruction), and write the reports to the file" << std::endl;
+	std::cerr << "  -c                 Run as a CHIP-8, rather than a SCHIP" << std::endl;
+	std::cerr << "  -q <profile>       Quirk profile:  default, cosmac or schip (default default)" << std::endl;
+	std::cerr << "  -d <database>      Use the quirk profile of each program listed in the ROM database" << std::endl;
+	std::cerr << "  -C <index>         Read programs through the ROM catalog in the index, and use their cataloged quirk profiles" << std::endl;
+	std::cerr << "  -v                 Show output from the programs" << std::endl;
+}
+
+
+/*****
+* main()
+*
+* Parse the arguments, then run every instance of every program, and report
+* the results.
+*****/
+int main(int argc, char** argv)
+{
+	Settings settings;
+	settings.instruction_budget = DEFAULT_INSTRUCTION_BUDGET;
+	settings.instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+	settings.engine = STEP_ENGINE;
+	settings.chip8_only = false;
+	settings.rewind_frames = 0;
+	settings.replay = NULL;
+	settings.seeded = false;
+	settings.seed = 0;
+	settings.profiling = false;
+
+	std::string profile_filename;
+
+	QuirkProfile quirks = DEFAULT_QUIRKS;
+	RomDatabase rom_database;
+	bool use_rom_database = false;
+	bool quirks_given = false;
+
+	RomCatalog rom_catalog;
+	std::string catalog_filename;
+
+	unsigned long frame_budget = 0;
+	unsigned int instances = 1;
+	unsigned int workers = std::thread::hardware_concurrency();
+	bool verbose = false;
+
+	Replay replay;
+
+	std::vector<std::string> filenames;
+
+	for(int i=1; i<argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if(arg == "-n" && has_value)
+		{
+			instances = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-i" && has_value)
+		{
+			settings.instruction_budget = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-f" && has_value)
+		{
+			frame_budget = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-p" && has_value)
+		{
+			settings.instructions_per_frame = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-e" && has_value)
+		{
+			std::string engine = argv[++i];
+			if(engine == "step")
+			{
+				settings.engine = STEP_ENGINE;
+			}
+			else if(engine == "block")
+			{
+				settings.engine = BLOCK_ENGINE;
+			}
+			else if(engine == "recompiler")
+			{
+				settings.engine = RECOMPILER_ENGINE;
+			}
+			else
+			{
+				std::cerr << "Unknown engine: " << engine << std::endl;
+				return 1;
+			}
+		}
+		else if(arg == "-j" && has_value)
+		{
+			workers = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-r" && has_value)
+		{
+			settings.rewind_frames = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-s" && has_value)
+		{
+			settings.seeded = true;
+			settings.seed = strtoul(argv[++i], NULL, 0);
+		}
+		else if(arg == "-P" && has_value)
+		{
+			if(!replay.load(argv[++i]))
+			{
+				return 1;
+			}
+			settings.replay = &replay;
+		}
+		else if(arg == "-o" && has_value)
+		{
+			settings.profiling = true;
+			profile_filename = argv[++i];
+		}
+		else if(arg == "-c")
+		{
+			settings.chip8_only = true;
+		}
+		else if(arg == "-q" && has_value)
+		{
+			std::string name = argv[++i];
+			if(!find_quirk_profile(name, &quirks))
+			{
+				std::cerr << "Unknown quirk profile: " << name << std::endl;
+				return 1;
+			}
+			quirks_given = true;
+		}
+		else if(arg == "-d" && has_value)
+		{
+			if(!rom_database.load(argv[++i]))
+			{
+				return 1;
+			}
+			use_rom_database = true;
+		}
+		else if(arg == "-C" && has_value)
+		{
+			catalog_filename = argv[++i];
+		}
+		else if(arg == "-v")
+		{
+			verbose = true;
+		}
+		else if(arg[0] == '@')
+		{
+			if(!load_program_list(arg.substr(1), filenames))
+			{
+				return 1;
+			}
+		}
+		else if(arg[0] == '-')
+		{
+			print_usage();
+			return 1;
+		}
+		else
+		{
+			struct stat status;
+			if(stat(arg.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+			{
+				RomImage::find_roms(arg, filenames);
+			}
+			else
+			{
+				filenames.push_back(arg);
+			}
+		}
+	}
+
+	if(filenames.empty())
+	{
+		print_usage();
+		return 1;
+	}
+
+	if(settings.instructions_per_frame == 0)
+	{
+		settings.instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+	}
+	if(frame_budget > 0)
+	{
+		settings.instruction_budget = frame_budget * settings.instructions_per_frame;
+	}
+
+	// Replays run exactly the frames recorded
+	if(settings.replay)
+	{
+		settings.instructions_per_frame = replay.get_instructions_per_frame();
+		settings.instruction_budget = (unsigned long) replay.get_num_frames() * settings.instructions_per_frame;
+	}
+	if(workers == 0)
+	{
+		workers = 1;
+	}
+
+	// Programs cataloged in an earlier run are taken from the index
+	if(!catalog_filename.empty())
+	{
+		if(use_rom_database)
+		{
+			rom_catalog.set_rom_database(&rom_database);
+		}
+		if(std::ifstream(catalog_filename.c_str()).good() && !rom_catalog.load(catalog_filename.c_str()))
+		{
+			return 1;
+		}
+	}
+
+	// Read or map every program once, up front, and share it between its
+	// instances
+	std::vector<Program> programs;
+	std::vector<RomImage*> images;
+	for(unsigned int i=0; i<filenames.size(); i++)
+	{
+		Program program;
+		program.filename = filenames[i];
+
+		if(!catalog_filename.empty())
+		{
+			const CatalogEntry* entry = rom_catalog.add(filenames[i].c_str());
+			if(!entry)
+			{
+				continue;
+			}
+
+			program.data = entry->data.data();
+			program.size = entry->data.size();
+			program.quirks = quirks_given ? quirks : entry->quirks;
+		}
+		else
+		{
+			RomImage* image = new RomImage();
+			if(!image->open(filenames[i]))
+			{
+				delete image;
+				continue;
+			}
+			images.push_back(image);
+
+			program.data = image->get_data();
+			program.size = image->get_size();
+
+			// Resolve the quirks once for all instances
+			program.quirks = quirks;
+			if(use_rom_database)
+			{
+				rom_database.find(program.data, program.size, &program.quirks);
+			}
+		}
+
+		programs.push_back(program);
+	}
+
+	if(rom_catalog.is_changed() && !rom_catalog.save(catalog_filename.c_str()))
+	{
+		return 1;
+	}
+
+	std::vector<Job> jobs;
+	for(unsigned int i=0; i<programs.size(); i++)
+	{
+		for(unsigned int j=0; j<instances; j++)
+		{
+			Job job = {i, j};
+			jobs.push_back(job);
+		}
+	}
+
+	if(workers > jobs.size())
+	{
+		workers = jobs.size();
+	}
+
+	// The chips report some instructions (e.g., mode changes) on std::cout.
+	// Silence them unless asked, so the report isn't drowned out.
+	std::streambuf* cout_buffer = std::cout.rdbuf();
+	if(!verbose)
+	{
+		std::cout.rdbuf(NULL);
+	}
+
+	std::vector<std::string> reports(jobs.size());
+	std::vector<std::string> profiles(jobs.size());
+	std::atomic<unsigned int> next_job(0);
+	std::atomic<unsigned long> total_instructions(0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for(unsigned int i=0; i<workers; i++)
+	{
+		threads.push_back(std::thread(run_jobs, &programs, &jobs, &settings, &next_job, &reports, &profiles, &total_instructions));
+	}
+	for(unsigned int i=0; i<threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout.rdbuf(cout_buffer);
+	std::cout.clear();
+
+	for(unsigned int i=0; i<reports.size(); i++)
+	{
+		std::cout << reports[i] << std::endl;
+	}
+
+	if(settings.profiling)
+	{
+		std::ofstream profile_file(profile_filename.c_str());
+		if(!profile_file.is_open())
+		{
+			std::cerr << "ERROR: Profile " << profile_filename << " could not be written!" << std::endl;
+			return 1;
+		}
+
+		for(unsigned int i=0; i<profiles.size(); i++)
+		{
+			profile_file << profiles[i];
+		}
+	}
+
+	for(unsigned int i=0; i<images.size(); i++)
+	{
+		delete images[i];
+	}
+
+	std::cerr << jobs.size() << " instances, " << total_instructions << " instructions in " << seconds << " s on "
+	          << workers << " workers (" << (seconds > 0 ? total_instructions / seconds / 1e6 : 0.0) << " MIPS)" << std::endl;
+
+	return 0;
+}
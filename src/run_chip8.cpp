@@ -12,11 +12,18 @@
 #include "core/computer.h"
 
 #include "core/clock.h"
+#include "core/rewind.h"
+#include "core/replay.h"
+#include "core/frame_buffer.h"
+#include "core/rom_database.h"
+#include "core/rom_catalog.h"
 
 #include "view/gtkmm_gui.h"
 #include "view/simple_sdl_gui.h"
 
+#include <fstream>
 #include <iostream>
+#include <string>
 
 /*****
 * main()
@@ -28,10 +35,20 @@ int main(int argc, char** argv)
 	// Did the user provide a file to run?
 //	if(argc < 2)
 //	{
-//		std::cout << "Program file not provided!  USAGE:  RunChip8 <program.ch8>" << std::endl;
+//		std::cout << "Program file not provided!  USAGE:  RunChip8 [-C <index>] <program.ch8> [replay]" << std::endl;
 //		return 0;
 //	}
 
+	// Programs are only read through a ROM catalog if given an index to keep
+	// it in (-C <index>), before the program
+	const char* catalog_filename = NULL;
+	int program_arg = 1;
+	if(argc > 3 && std::string(argv[1]) == "-C")
+	{
+		catalog_filename = argv[2];
+		program_arg = 3;
+	}
+
 	// Create a keyboard, memory and display
 	Keyboard* keyboard = new Keyboard();
 	Display* display = new Display();
@@ -43,6 +60,32 @@ int main(int argc, char** argv)
 
 	computer->soft_reset();
 
+	// Run known programs with the quirks they need
+	RomDatabase* rom_database = new RomDatabase();
+	rom_database->load(DEFAULT_ROM_DATABASE);
+
+	// Programs run before are loaded from the catalog, without reading them
+	// again
+	RomCatalog* rom_catalog = NULL;
+	if(catalog_filename)
+	{
+		rom_catalog = new RomCatalog();
+		rom_catalog->set_rom_database(rom_database);
+		if(std::ifstream(catalog_filename).good())
+		{
+			rom_catalog->load(catalog_filename);
+		}
+		computer->set_rom_catalog(rom_catalog);
+	}
+
+	// Keep the last minute, to rewind through
+	Rewind* rewind = new Rewind(computer);
+	clock->set_rewind(rewind);
+
+	// Frames are handed to the GUI's thread to draw
+	FrameBuffer* frame_buffer = new FrameBuffer(display);
+	clock->set_frame_buffer(frame_buffer);
+
 	// Build the GUI, and start it up!
 //	GtkmmGui* gui = new GtkmmGui(computer, argc, argv);
 	SimpleSDLGui* gui = new SimpleSDLGui(computer, argc, argv);
@@ -52,12 +95,36 @@ int main(int argc, char** argv)
 	
 	clock->start();
 
-	computer->load(argv[1]);
+	computer->load(argv[program_arg]);
+
+	// Record a replay of the session, if given a file to save it to
+	Replay* replay = NULL;
+	if(argc > program_arg + 1)
+	{
+		replay = new Replay();
+		replay->record(computer);
+		clock->add_listener(replay);
+	}
 
 	gui->run();
 
 
 	delete clock;
+	delete rewind;
+	delete frame_buffer;
+	if(rom_catalog && rom_catalog->is_changed())
+	{
+		rom_catalog->save(catalog_filename);
+	}
+	delete rom_catalog;
+	delete rom_database;
+
+	if(replay)
+	{
+		replay->stop();
+		replay->save(argv[program_arg + 1]);
+		delete replay;
+	}
 
 	return 0;
 }
\ No newline at end of file
@@ -339,7 +339,10 @@ void GladeGui::update_address_register(unsigned short value)
 
 void GladeGui::fill_memory_display()
 {
-	gtk_label_set_text(GTK_LABEL (memory_display), computer->get_memory_string().c_str());
+	if(computer->get_memory()->render_dirty_lines(memory_text) > 0)
+	{
+		gtk_label_set_text(GTK_LABEL (memory_display), memory_text);
+	}
 }
 
 
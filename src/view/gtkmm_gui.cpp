@@ -428,7 +428,10 @@ void GtkmmGui::update_sound_timer(unsigned short value)
 void GtkmmGui::update_memory()
 {
 //	memory_display->set_text(computer->get_memory_string());
-	stale_values[memory_display] = computer->get_memory_string();
+	if(computer->get_memory()->render_dirty_lines(memory_text) > 0)
+	{
+		stale_values[memory_display] = memory_text;
+	}
 }
 
 
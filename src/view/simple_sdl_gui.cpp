@@ -7,6 +7,9 @@
 #include <string>
 #include <iterator>
 #include <map>
+#include <thread>
+
+#include <string.h>
 
 extern "C" {
 
@@ -16,6 +19,14 @@ extern "C" {
 
 SimpleSDLGui::SimpleSDLGui(Computer* _computer, int argc, char** argv)
 {
+	window = NULL;
+	renderer = NULL;
+	screen_texture = NULL;
+
+	vsync = false;
+	drawn_generation = 0;
+	redraw = true;
+
 	// Initialize SDL -- return if it cannot
 	if(SDL_Init(SDL_INIT_VIDEO) < 0)
 	{
@@ -23,9 +34,10 @@ SimpleSDLGui::SimpleSDLGui(Computer* _computer, int argc, char** argv)
 		return;
 	}
 
-	if(!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"))
+	// The screen texture is scaled up, and each pixel should stay square
+	if(!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0"))
 	{
-		std::cout << "Warning: Linear texture filtering not enabled!" << std::endl;
+		std::cout << "Warning: Nearest pixel texture filtering not enabled!" << std::endl;
 	}
 
 	computer = _computer;
@@ -36,6 +48,14 @@ SimpleSDLGui::SimpleSDLGui(Computer* _computer, int argc, char** argv)
 
 SimpleSDLGui::~SimpleSDLGui()
 {
+	if(screen_texture)
+	{
+		SDL_DestroyTexture(screen_texture);
+	}
+	if(renderer)
+	{
+		SDL_DestroyRenderer(renderer);
+	}
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 }
@@ -50,6 +70,10 @@ void SimpleSDLGui::build()
 	renderer = NULL;
 	screenSurface = NULL;
 
+	screen_texture = NULL;
+	texture_width = 0;
+	texture_height = 0;
+
 	// Create the main window and a renderer
 	window = SDL_CreateWindow("Chip-8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, window_width, window_height, SDL_WINDOW_SHOWN);
 
@@ -60,7 +84,12 @@ void SimpleSDLGui::build()
 	}
 
 	// Create the renderer for the window
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+	if(vsync)
+	{
+		renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+	}
+	renderer = SDL_CreateRenderer(window, -1, renderer_flags);
 
 	if(renderer == NULL)
 	{
@@ -71,10 +100,37 @@ void SimpleSDLGui::build()
 	SDL_RenderClear(renderer);
 
 	SDL_RenderPresent(renderer);
+
+	// Colors of the pixels, in the format of the screen texture
+	SDL_PixelFormat* format = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888);
+	foreground_color = SDL_MapRGBA(format, 0x40, 0x40, 0x40, 0xFF);
+	background_color = SDL_MapRGBA(format, 0xD0, 0xD0, 0xD0, 0xFF);
+	SDL_FreeFormat(format);
+
+	for(int value=0; value<256; value++)
+	{
+		for(int bit=0; bit<8; bit++)
+		{
+			byte_texels[value][bit] = (value & (0x80 >> bit)) ? foreground_color : background_color;
+		}
+	}
+}
+
+
+/*******************
+* set_vsync(bool vsync)
+*
+* Wait for the monitor's refresh when presenting the screen, so it doesn't
+* tear.  Only the GUI's thread waits;  the clock keeps running.  Should be set
+* before build().
+*******************/
+void SimpleSDLGui::set_vsync(bool _vsync)
+{
+	vsync = _vsync;
 }
 
 
-void SimpleSDLGui::draw()
+void SimpleSDLGui::draw(const Frame* frame)
 {
 	// Clear the window
 	SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
@@ -95,48 +151,118 @@ void SimpleSDLGui::draw()
 	SDL_RenderDrawRect(renderer, &screen_border);
 
 	// Draw the display
-	draw_screen(screen_x, screen_y, screen_width, screen_height);
+	draw_screen(frame, screen_x, screen_y, screen_width, screen_height);
 }
 
 
-void SimpleSDLGui::draw_screen(int _x, int _y, int display_width, int display_height)
+void SimpleSDLGui::draw_screen(const Frame* frame, int _x, int _y, int display_width, int display_height)
 {
-	// How big to make each pixel?
-	int pixel_width = display_width / computer->get_display_width();
-	int pixel_height = display_height / computer->get_display_height();
+	if(!frame || frame->width == 0 || frame->height == 0)
+	{
+		SDL_RenderPresent(renderer);
+		return;
+	}
 
-	// Loop through the display and draw rectangles where the bits are set
-	for(int x=0; x < computer->get_display_width(); x++)
+	if(!update_screen_texture(frame))
 	{
-		for(int y=0; y < computer->get_display_height(); y++)
+		SDL_RenderPresent(renderer);
+		return;
+	}
+
+	// Scale the texture to the largest whole multiple of the frame which
+	// fits the screen, as the pixels were drawn before
+	int pixel_width = display_width / frame->width;
+	int pixel_height = display_height / frame->height;
+
+	SDL_Rect screen = {_x, _y, (int) frame->width * pixel_width, (int) frame->height * pixel_height};
+	SDL_RenderCopy(renderer, screen_texture, NULL, &screen);
+
+	// Update the window
+	SDL_RenderPresent(renderer);
+}
+
+
+/*******************
+* update_screen_texture(const Frame* frame)
+*
+* Expand the packed pixels of the frame into the screen texture, creating
+* the texture again if the size of the frame has changed.  Returns false if
+* the texture couldn't be created or locked.
+*******************/
+bool SimpleSDLGui::update_screen_texture(const Frame* frame)
+{
+	if(!screen_texture || texture_width != frame->width || texture_height != frame->height)
+	{
+		if(screen_texture)
 		{
-			// Rectangle for the pixel
-			SDL_Rect pixel = {x*pixel_width + _x, y*pixel_height + _y, pixel_width, pixel_height};
+			SDL_DestroyTexture(screen_texture);
+		}
 
-			// Pick the color as background or foreground
-			if(computer->get_pixel(x,y))		// Foreground color
-			{
-				SDL_SetRenderDrawColor(renderer, 0x40, 0x40, 0x40, 0xFF);
-			}
-			else								// Background color
-			{
-				SDL_SetRenderDrawColor(renderer, 0xD0, 0xD0, 0xD0, 0xFF);
-			}
-			
-			// Draw the pixel
-			SDL_RenderFillRect(renderer, &pixel);
+		screen_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, frame->width, frame->height);
+		if(!screen_texture)
+		{
+			std::cout << "ERROR: Screen texture could not be created!  SDL_ERROR: " << SDL_GetError() << std::endl;
+			texture_width = 0;
+			texture_height = 0;
+			return false;
 		}
+
+		texture_width = frame->width;
+		texture_height = frame->height;
 	}
 
-	// Update the window
-	SDL_RenderPresent(renderer);
+	void* pixels;
+	int pitch;
+	if(SDL_LockTexture(screen_texture, NULL, &pixels, &pitch) != 0)
+	{
+		std::cout << "ERROR: Screen texture could not be locked!  SDL_ERROR: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	// Pixels are expanded a byte (eight texels) at a time, and any left over
+	// at the end of a row which isn't a multiple of eight one at a time
+	unsigned int whole_bytes = frame->width / 8;
+
+	for(unsigned int y=0; y < frame->height; y++)
+	{
+		Uint32* texels = (Uint32*) ((Uint8*) pixels + y*pitch);
+		const uint64_t* row = &frame->words[y * frame->words_per_row];
+
+		for(unsigned int i=0; i < whole_bytes; i++)
+		{
+			unsigned char value = (row[i / 8] >> (56 - 8*(i % 8))) & 0xFF;
+			memcpy(&texels[8*i], byte_texels[value], sizeof(byte_texels[value]));
+		}
+
+		for(unsigned int x=8*whole_bytes; x < frame->width; x++)
+		{
+			bool pixel = (row[x / 64] >> (63 - x % 64)) & 1;
+			texels[x] = pixel ? foreground_color : background_color;
+		}
+	}
+
+	SDL_UnlockTexture(screen_texture);
+
+	return true;
 }
 
 
+/*******************
+* run()
+*
+* Handle events and redraw the screen SCREEN_FPS times a second, until the
+* window is closed.  Between iterations the thread sleeps until the next one
+* is due, scheduled a fixed period after the last, rather than spinning.  The
+* screen is only redrawn if the newest frame from the clock is different from
+* the one last drawn, or the window has been exposed or resized.
+*******************/
 void SimpleSDLGui::run()
 {
-	// Timer to cap the number of frames per second to 60
-	unsigned int startTime = 0;
+	std::chrono::duration<double> frame_period(1.0 / SCREEN_FPS);
+	std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
+
+	// Frames drawn by the clock's thread
+	FrameBuffer* frame_buffer = computer->get_clock()->get_frame_buffer();
 
 	// Main execution flag
 	bool quit = false;
@@ -150,9 +276,6 @@ void SimpleSDLGui::run()
 	// Run the application until quit
 	while(!quit)
 	{
-		// Get the timer
-		startTime = SDL_GetTicks();
-
 		const unsigned char* keyboard_state = SDL_GetKeyboardState(NULL);
 /*
 		if(keyboard_state[Key0])	computer->press_key(0x00);	else	computer->release_key(0x00);
@@ -181,6 +304,12 @@ void SimpleSDLGui::run()
 				quit = true;
 			}
 
+			// The window may have been uncovered or resized
+			if(event.type == SDL_WINDOWEVENT)
+			{
+				redraw = true;
+			}
+
 			// Handle key presses
 			if(event.type == SDL_KEYDOWN && event.key.repeat == 0)
 			{
@@ -205,6 +334,8 @@ void SimpleSDLGui::run()
 				// Resize the display?
 				if(event.key.keysym.sym == SDLK_UP)		computer->resize_display(128,64);
 				if(event.key.keysym.sym == SDLK_DOWN)	computer->resize_display(64,32);
+
+				if(event.key.keysym.sym == KeyRewind)	computer->get_clock()->set_rewinding(true);
 			}
 
 			if(event.type == SDL_KEYUP && event.key.repeat == 0)
@@ -225,15 +356,33 @@ void SimpleSDLGui::run()
 				if(event.key.keysym.sym == KeyD)	computer->release_key(0x0D);
 				if(event.key.keysym.sym == KeyE)	computer->release_key(0x0E);
 				if(event.key.keysym.sym == KeyF)	computer->release_key(0x0F);
+
+				if(event.key.keysym.sym == KeyRewind)	computer->get_clock()->set_rewinding(false);
 			}
 
 		}
 
-		draw();
+		const Frame* frame = frame_buffer ? frame_buffer->take() : NULL;
+
+		if(redraw || (frame && frame->generation != drawn_generation))
+		{
+			draw(frame);
+
+			drawn_generation = frame ? frame->generation : 0;
+			redraw = false;
+		}
+
+		// Sleep until the next iteration is due.  As with the clock, if the
+		// GUI has fallen too far behind, start again from now.
+		next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_period);
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(now - next_frame > MAX_FRAMES_BEHIND * frame_period)
+		{
+			next_frame = now;
+		}
 
-		// Wait until enough ticks have passed
-		while(SDL_GetTicks() - startTime < SCREEN_TICKS_PER_FRAME);
-//		SDL_Delay(50);
+		std::this_thread::sleep_until(next_frame);
 
 	}
 }